@@ -0,0 +1,111 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#if !defined(__NORI_AOV_H)
+#define __NORI_AOV_H
+
+#include <nori/color.h>
+#include <vector>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Arbitrary output variables (AOVs) of a single pixel sample
+ *
+ * AOVs are auxiliary images (e.g. the inputs of a denoiser or of a
+ * compositing step) that are rendered in the same pass as the radiance:
+ * the integrator fills this record while tracing the camera ray, and the
+ * renderer splats the requested values into additional planes of the
+ * image block (see \ref ImageBlock::setAOVCount()). They are saved as
+ * layers of the output EXR file.
+ *
+ * The surface AOVs describe the first intersection of the camera ray
+ * (and are zero if it escapes). Integrators that do not provide them
+ * leave \c hasSurface unset, and the renderer then intersects the camera
+ * ray once more. The direct/indirect split is only available from
+ * integrators that set \c hasSplit, and is black otherwise.
+ */
+struct AOVRecord {
+    /// Kinds of AOVs
+    enum EType {
+        /// Reflectance of the first surface (see \ref BSDF::getAlbedo())
+        EAlbedo = 0,
+        /// Shading normal of the first surface (in world space)
+        ENormal,
+        /// Distance to the first surface along the camera ray
+        EDepth,
+        /// Position of the first surface (in world space)
+        EPosition,
+        /// Emitted light and direct illumination of the first surface
+        EDirect,
+        /// All light that was scattered more than once
+        EIndirect,
+        /// Variance of the pixel estimate (accumulated by the renderer as
+        /// the second moment of the samples)
+        EVariance,
+        /// Number of samples of the pixel (written per tile by the renderer)
+        ESampleCount,
+        ETypeCount
+    };
+
+    /// Per-sample values of the AOVs (indexed by \ref EType)
+    Color3f values[ESampleCount];
+
+    /// Have the surface AOVs been written?
+    bool hasSurface = false;
+
+    /// Has the direct/indirect split been written?
+    bool hasSplit = false;
+
+    /**
+     * \brief Record the surface AOVs of the first intersection
+     *
+     * \param its
+     *    The intersection, or \c nullptr if the camera ray escaped
+     */
+    void setSurface(const Intersection *its);
+
+    /// Record the split of the radiance into direct and indirect light
+    void setSplit(const Color3f &direct, const Color3f &indirect) {
+        values[EDirect] = direct;
+        values[EIndirect] = indirect;
+        hasSplit = true;
+    }
+
+    /// Parse the name of an AOV ("albedo", "normal", "depth", ..)
+    static EType typeFromString(const std::string &name);
+
+    /// Parse a comma-separated list of AOV names
+    static std::vector<EType> parseList(const std::string &list);
+
+    /// Return the name of an AOV (which is also the name of its EXR layer)
+    static std::string typeName(EType type);
+
+    /**
+     * \brief Return the channel names of the EXR layer of an AOV
+     *
+     * One letter per channel, e.g. "RGB" for colors, "XYZ" for vectors
+     * and "Z" for the depth. Single-channel AOVs only store the first
+     * component of the value.
+     */
+    static const char *channelNames(EType type);
+};
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_AOV_H */
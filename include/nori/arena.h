@@ -0,0 +1,105 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#if !defined(__NORI_ARENA_H)
+#define __NORI_ARENA_H
+
+#include <nori/common.h>
+#include <tbb/task_arena.h>
+#include <exception>
+#include <memory>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Group of threads that executes the parallel parts of a rendering
+ *
+ * Wraps a <tt>tbb::task_arena</tt> with an explicit number of threads. The
+ * parallel algorithms invoked from \ref execute() (BVH construction,
+ * integrator preprocessing, the render loop) only use the threads of the
+ * arena, so several renderings can share a machine without competing for
+ * TBB's global thread pool.
+ *
+ * On Linux, the threads can additionally be bound to the CPUs of one NUMA
+ * node and/or pinned to individual CPUs. Memory that is first written by
+ * code running in such an arena (e.g. the frame buffer) is then allocated
+ * on the node that uses it.
+ */
+class ThreadArena {
+public:
+    /**
+     * \brief Create an arena
+     *
+     * \param threads
+     *    Number of threads, including the thread that calls \ref execute()
+     *    (0: one per CPU of the NUMA node, or per core if no node is given)
+     * \param numaNode
+     *    Only run on the CPUs of this NUMA node (-1: on all CPUs)
+     * \param pinThreads
+     *    Bind every thread of the arena to a single CPU
+     */
+    ThreadArena(int threads = 0, int numaNode = -1, bool pinThreads = false);
+
+    /// Release the arena
+    ~ThreadArena();
+
+    /// Return the number of threads of the arena
+    int getThreadCount() const { return m_threads; }
+
+    /**
+     * \brief Run \c f on the calling thread within the arena
+     *
+     * Exceptions thrown by \c f are passed on to the caller.
+     */
+    template <typename Functor> void execute(const Functor &f) {
+        std::exception_ptr error;
+        m_arena->execute([&] {
+            try {
+                f();
+            } catch (...) {
+                error = std::current_exception();
+            }
+        });
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    /// Return a human-readable summary
+    std::string toString() const;
+
+    /**
+     * \brief Return the CPUs of a NUMA node that the process may use
+     *
+     * Throws an exception if the node does not exist or NUMA information
+     * is unavailable on this platform.
+     */
+    static std::vector<int> getNodeCPUs(int node);
+
+protected:
+    class AffinityObserver;
+
+    int m_threads;
+    int m_numaNode;
+    bool m_pinThreads;
+    std::unique_ptr<tbb::task_arena> m_arena;
+    std::unique_ptr<AffinityObserver> m_observer;
+};
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_ARENA_H */
@@ -45,11 +45,30 @@ public:
     /// Load an OpenEXR file with the specified filename
     Bitmap(const std::string &filename);
 
-    /// Save the bitmap as an EXR file with the specified filename
-    void save(const std::string &filename);
+    /// An additional image that is saved as a layer of a multi-layer EXR file
+    struct Layer {
+        /// Name of the layer, which prefixes its channels (e.g. "albedo.R")
+        std::string name;
+        /// One letter per channel, e.g. "RGB" or "Z" (only the first component)
+        std::string channels;
+        /// Pixels of the layer (of the same size as the bitmap)
+        const Bitmap *bitmap;
+    };
+
+    /**
+     * \brief Save the bitmap as an EXR file with the specified filename
+     *
+     * \param layers
+     *    Additional images (e.g. AOVs) that are stored as layers of the
+     *    same file, next to the RGB channels of the bitmap
+     * \param verbose
+     *    Print a message about the written file
+     */
+    void save(const std::string &filename, const std::vector<Layer> &layers = std::vector<Layer>(),
+              bool verbose = true);
 
     /// Save the bitmap as a PNG file with the specified filename
-    void saveToLDR(const std::string &filename);
+    void saveToLDR(const std::string &filename, bool verbose = true);
 };
 
 NORI_NAMESPACE_END
@@ -26,6 +26,7 @@
 #include <nori/color.h>
 #include <nori/vector.h>
 #include <tbb/mutex.h>
+#include <atomic>
 
 #define NORI_BLOCK_SIZE 32 /* Block size used for parallelization */
 
@@ -47,6 +48,9 @@ NORI_NAMESPACE_BEGIN
  */
 class ImageBlock : public Eigen::Array<Color4f, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> {
 public:
+    /// Pixels of an image plane (color and accumulated filter weight)
+    typedef Eigen::Array<Color4f, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> Plane;
+
     /**
      * Create a new image block of the specified maximum size
      * \param size
@@ -88,14 +92,78 @@ public:
      */
     Bitmap *toBitmap() const;
 
+    /**
+     * \brief Turn a rectangular region of the block into a proper bitmap
+     *
+     * \param offset
+     *    Upper left corner of the region (in image coordinates)
+     * \param size
+     *    Size of the region, which must lie within the block
+     * \param crop
+     *    If \c true, the bitmap only contains the region. Otherwise it has
+     *    the size of the block and is black outside of the region (which
+     *    discards the partially filtered pixels around a crop window).
+     */
+    Bitmap *toBitmap(const Point2i &offset, const Vector2i &size, bool crop) const;
+
+    /**
+     * \brief Turn a rectangular region of an AOV plane into a bitmap
+     *
+     * Same as \ref toBitmap(), but for the plane with the given index
+     * (see \ref setAOVCount())
+     */
+    Bitmap *aovToBitmap(int index, const Point2i &offset, const Vector2i &size, bool crop) const;
+
     /// Convert a bitmap into an image block
     void fromBitmap(const Bitmap &bitmap);
 
     /// Clear all contents
-    void clear() { setConstant(Color4f()); }
+    void clear() {
+        setConstant(Color4f());
+        for (Plane &plane : m_aovs)
+            plane.setConstant(Color4f());
+    }
+
+    /**
+     * \brief Allocate planes for arbitrary output variables (AOVs)
+     *
+     * Every plane covers the block (incl. border) and accumulates values
+     * with the same filter weights as the radiance. The number of planes
+     * is kept by \ref init().
+     */
+    void setAOVCount(int count);
+
+    /// Return the number of AOV planes
+    int getAOVCount() const { return (int) m_aovs.size(); }
+
+    /// Return an AOV plane
+    const Plane &getAOV(int index) const { return m_aovs[index]; }
+    Plane &getAOV(int index) { return m_aovs[index]; }
+
+    /**
+     * \brief Record a sample with the given position and radiance value
+     *
+     * Negative, NaN and infinite values are discarded and counted (see
+     * \ref getInvalidSampleCount()), unless \ref setSampleCheck()
+     * disabled the check.
+     *
+     * \param aovs
+     *    Optional values of the AOV planes (one per plane), which are
+     *    splatted with the same filter weights as the radiance
+     */
+    void put(const Point2f &pos, const Color3f &value, const Color3f *aovs = nullptr);
 
-    /// Record a sample with the given position and radiance value
-    void put(const Point2f &pos, const Color3f &value);
+    /// Return the number of invalid samples that \ref put() discarded
+    uint64_t getInvalidSampleCount() const { return m_invalidSamples; }
+
+    /**
+     * \brief Enable or disable the check of the sample values in \ref put()
+     *
+     * Enabled by default, and kept by \ref init(). Without the check,
+     * invalid values are accumulated like any other (and spoil their
+     * pixels), and nothing is counted.
+     */
+    void setSampleCheck(bool enabled) { m_sampleCheck = enabled; }
 
     /**
      * \brief Merge another image block into this one
@@ -105,6 +173,14 @@ public:
      */
     void put(ImageBlock &b);
 
+    /**
+     * \brief Merge another image block into this one without locking
+     *
+     * The caller must ensure that no other thread accesses the
+     * affected pixels during the merge.
+     */
+    void accumulate(const ImageBlock &b);
+
     /// Lock the image block (using an internal mutex)
     inline void lock() const { m_mutex.lock(); }
     
@@ -114,6 +190,15 @@ public:
     /// Return a human-readable string summary
     std::string toString() const;
 protected:
+    /**
+     * \brief Splat a sample whose filter footprint covers at most
+     * \c N x \c N pixels (in block coordinates)
+     *
+     * \return \c false if the footprint crosses the edge of the block,
+     *    in which case nothing was written
+     */
+    template <int N> bool splat(const Point2f &pos, const Color3f &value, const Color3f *aovs);
+
     Point2i m_offset;
     Vector2i m_size;
     int m_borderSize = 0;
@@ -122,33 +207,65 @@ protected:
     float *m_weightsX = nullptr;
     float *m_weightsY = nullptr;
     float m_lookupFactor = 0;
+    int m_footprint = 0; // pixels with a nonzero filter weight per axis
+    uint64_t m_invalidSamples = 0;
+    bool m_sampleCheck = true;
     uint32_t m_blockId; // id given by the block generator
+    std::vector<Plane> m_aovs;
     mutable tbb::mutex m_mutex;
 };
 
 /**
- * \brief Spiraling block generator
+ * \brief Block generator
  *
  * This class can be used to chop up an image into many small
- * rectangular blocks suitable for parallel rendering. The blocks
- * are ordered in spiraling pattern so that the center is
- * rendered first.
+ * rectangular blocks suitable for parallel rendering. By default, the
+ * blocks are ordered in spiraling pattern so that the center is
+ * rendered first. Alternatively, they can follow a Hilbert or Morton
+ * curve, so that consecutive blocks are neighbours and share the
+ * geometry in the caches.
  */
 class BlockGenerator {
 public:
+    /// Order in which the blocks are handed out
+    enum EOrder {
+        /// Spiral that starts at the center of the image
+        ESpiral = 0,
+        /// Hilbert curve
+        EHilbert,
+        /// Morton (Z-order) curve
+        EMorton
+    };
+
     /**
      * \brief Create a block generator with
      * \param size
      *      Size of the image that should be split into blocks
      * \param blockSize
      *      Maximum size of the individual blocks
+     * \param order
+     *      Order of the blocks
+     */
+    BlockGenerator(const Vector2i &size, int blockSize, EOrder order = ESpiral);
+
+    /**
+     * \brief Create a block generator for a subregion of the image
+     * \param offset
+     *      Upper left corner of the region that should be split into blocks
+     * \param size
+     *      Size of the region
+     * \param blockSize
+     *      Maximum size of the individual blocks
+     * \param order
+     *      Order of the blocks
      */
-    BlockGenerator(const Vector2i &size, int blockSize);
+    BlockGenerator(const Point2i &offset, const Vector2i &size, int blockSize,
+                   EOrder order = ESpiral);
     
     /**
      * \brief Return the next block to be rendered
      *
-     * This function is thread-safe
+     * This function is thread-safe (and lock-free)
      *
      * \return \c false if there were no more blocks
      */
@@ -162,19 +279,29 @@ public:
     void reset();
 
     /// Return the total number of blocks
-    int getBlockCount() const { return m_blocksLeft; }
-protected:
-    enum EDirection { ERight = 0, EDown, ELeft, EUp };
+    int getBlockCount() const { return (int) m_order.size(); }
 
-    Point2i m_block;
+    /// Parse the name of a block order ("spiral", "hilbert" or "morton")
+    static EOrder orderFromString(const std::string &name);
+
+    /**
+     * \brief Choose the block size for rendering an image (region)
+     *
+     * Starts from \ref NORI_BLOCK_SIZE and halves the size until every
+     * thread receives several blocks, so that small images keep all
+     * cores busy. Blocks stay larger than twice the border of the
+     * reconstruction filter, since the border is rendered redundantly
+     * by neighbouring blocks.
+     */
+    static int optimalBlockSize(const Vector2i &size, int threads, int borderSize);
+protected:
+    /// Grid coordinates of all blocks in rendering order
+    std::vector<Point2i> m_order;
     Vector2i m_numBlocks;
+    Point2i m_offset;
     Vector2i m_size;
     int m_blockSize;
-    int m_numSteps;
-    int m_blocksLeft;
-    int m_stepsLeft;
-    int m_direction;
-    tbb::mutex m_mutex;
+    std::atomic<int> m_next;
 };
 
 NORI_NAMESPACE_END
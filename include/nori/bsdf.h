@@ -23,6 +23,31 @@
 
 NORI_NAMESPACE_BEGIN
 
+/**
+ * \brief Scattering lobes of a BSDF
+ *
+ * These are combined into a bit mask by \ref BSDF::getFlags() and allow
+ * integrators to skip work that cannot contribute, e.g. emitter sampling
+ * on a purely specular surface.
+ */
+enum EBSDFFlags {
+    /// Ideal specular reflection (Dirac delta, e.g. a mirror)
+    EDeltaReflection   = 0x01,
+    /// Ideal specular transmission (Dirac delta, e.g. smooth glass)
+    EDeltaTransmission = 0x02,
+    /// Glossy scattering with a density wrt. solid angles
+    EGlossy            = 0x04,
+    /// Diffuse scattering with a density wrt. solid angles
+    EDiffuse           = 0x08,
+    /// The BSDF scatters light arriving from either side of the surface
+    ETwoSided          = 0x10,
+
+    /// All lobes that are described by a Dirac delta function
+    EDelta  = EDeltaReflection | EDeltaTransmission,
+    /// All lobes that can be evaluated by \ref BSDF::eval()
+    ESmooth = EGlossy | EDiffuse
+};
+
 /**
  * \brief Convenience data structure used to pass multiple
  * parameters to the evaluation and sampling routines in \ref BSDF
@@ -40,14 +65,20 @@ struct BSDFQueryRecord {
     /// Measure associated with the sample
     EMeasure measure;
 
+    /// Density of the sampled direction (as returned by \ref BSDF::pdf())
+    float pdf;
+
+    /// Lobe that produced the sampled direction (one of \ref EBSDFFlags)
+    uint32_t sampledLobe;
+
     /// Create a new record for sampling the BSDF
     BSDFQueryRecord(const Vector3f &wi)
-        : wi(wi), measure(EUnknownMeasure) { }
+        : wi(wi), measure(EUnknownMeasure), pdf(0.0f), sampledLobe(0) { }
 
     /// Create a new record for querying the BSDF
     BSDFQueryRecord(const Vector3f &wi,
             const Vector3f &wo, EMeasure measure)
-        : wi(wi), wo(wo), measure(measure) { }
+        : wi(wi), wo(wo), measure(measure), pdf(0.0f), sampledLobe(0) { }
 
 
     /// Additional information possibly needed by the BSDF
@@ -70,6 +101,11 @@ public:
      * \param bRec    A BSDF query record
      * \param sample  A uniformly distributed sample on \f$[0,1]^2\f$
      *
+     * Besides \c wo, \c eta and \c measure, this also fills in \c pdf
+     * (the value that \ref pdf() would return for the sampled direction)
+     * and \c sampledLobe, so integrators don't need to query the
+     * density separately.
+     *
      * \return The BSDF value divided by the probability density of the sample
      *         sample. The returned value also includes the cosine
      *         foreshortening factor associated with the outgoing direction,
@@ -118,6 +154,31 @@ public:
      * or not to store photons on a surface
      */
     virtual bool isDiffuse() const { return false; }
+
+    /**
+     * \brief Return the reflectance of the surface at the given UV
+     * coordinates (e.g. for the albedo AOV of a denoiser)
+     *
+     * The default reports a white surface, which suits specular and
+     * other BSDFs without a diffuse color.
+     */
+    virtual Color3f getAlbedo(const Point2f &uv) const { return Color3f(1.0f); }
+
+    /**
+     * \brief Return the scattering lobes of this BSDF as a combination
+     * of \ref EBSDFFlags
+     *
+     * The default conservatively reports glossy and diffuse lobes.
+     */
+    virtual uint32_t getFlags() const { return ESmooth; }
+
+    /**
+     * \brief Can this BSDF be evaluated for a pair of directions?
+     *
+     * When this returns \c false, \ref eval() is zero everywhere and
+     * emitter sampling cannot contribute.
+     */
+    bool hasSmoothComponent() const { return (getFlags() & ESmooth) != 0; }
 };
 
 NORI_NAMESPACE_END
@@ -61,6 +61,21 @@ public:
     /// Return the size of the output image in pixels
     const Vector2i &getOutputSize() const { return m_outputSize; }
 
+    /**
+     * \brief Override the size of the output image (e.g. from the
+     * command line) and reconfigure the camera accordingly
+     */
+    void setOutputSize(const Vector2i &size) {
+        m_outputSize = size;
+        activate();
+    }
+
+    /// Return the camera-to-world transformation
+    const Transform &getCameraToWorld() const { return m_cameraToWorld; }
+
+    /// Move the camera (e.g. to the next frame of an animation)
+    void setCameraToWorld(const Transform &cameraToWorld) { m_cameraToWorld = cameraToWorld; }
+
     /// Return the camera's reconstruction filter in image space
     const ReconstructionFilter *getReconstructionFilter() const { return m_rfilter; }
 
@@ -71,6 +86,7 @@ public:
     virtual EClassType getClassType() const override { return ECamera; }
 protected:
     Vector2i m_outputSize;
+    Transform m_cameraToWorld;
     ReconstructionFilter *m_rfilter;
 };
 
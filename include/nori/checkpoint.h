@@ -0,0 +1,136 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob, Romain Prévost
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#if !defined(__NORI_CHECKPOINT_H)
+#define __NORI_CHECKPOINT_H
+
+#include <nori/vector.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Snapshot of an in-progress rendering
+ *
+ * A checkpoint holds everything that is needed to continue a rendering
+ * in a fresh process: the unnormalized contents (color and filter weight)
+ * of every tile, the number of samples of every tile, the state of the
+ * tile samplers and the position in the pass schedule. Checkpoints are
+ * taken between passes, where all of this is consistent.
+ *
+ * The file format is a raw binary dump and is therefore not portable
+ * between machines with a different byte order.
+ */
+struct RenderCheckpoint {
+    /* Configuration of the rendering (must match when resuming) */
+    Vector2i outputSize = Vector2i(0, 0);
+    Point2i cropOffset = Point2i(0, 0);
+    Vector2i cropSize = Vector2i(0, 0);
+    int blockSize = 0;
+    int blockOrder = 0;
+    int borderSize = 0;
+    uint32_t sampleCount = 0;
+    bool adaptive = false;
+    uint32_t sampleOffset = 0;
+    uint32_t seedOffset = 0;
+    int workerIndex = 0;
+    int workerCount = 1;
+
+    /* Position in the pass schedule */
+    /// Frame of a batch rendering (earlier frames have been saved already)
+    uint32_t frame = 0;
+    /// Samples per pixel rendered by the tiles that are still active
+    uint32_t samples = 0;
+    /// Index of the next pass
+    uint32_t pass = 0;
+    /// Size of the last pass
+    uint32_t passSamples = 1;
+    /// Pixel samples rendered so far
+    uint64_t spent = 0;
+    /// Time spent on the frame so far (in seconds, incl. loading the scene)
+    double elapsed = 0;
+
+    /// State of a single tile
+    struct Tile {
+        /// Samples per pixel rendered so far
+        uint32_t samples = 0;
+        /// Does the tile still receive samples?
+        bool active = true;
+        /// Serialized state of the tile's sampler
+        std::string sampler;
+        /// Pixels (incl. border) as RGB + filter weight
+        std::vector<float> data;
+        /// Second half buffer of adaptive sampling
+        std::vector<float> halfData;
+    };
+    std::vector<Tile> tiles;
+
+    /**
+     * \brief Write the checkpoint to disk
+     *
+     * The data is first written to a temporary file, which then replaces
+     * \c filename. A crash during the write therefore never destroys the
+     * previous checkpoint.
+     */
+    void save(const std::string &filename) const;
+
+    /// Read a checkpoint from disk
+    void load(const std::string &filename);
+
+    /// Can a rendering with the configuration \c other resume from this checkpoint?
+    bool isCompatible(const RenderCheckpoint &other) const;
+};
+
+/**
+ * \brief Partial result of a distributed rendering
+ *
+ * Every worker of a distributed rendering renders a subset of the tiles
+ * and/or a range of the pixel samples, and stores its accumulation with
+ * unnormalized colors and filter weights. The \c nori-merge tool sums the
+ * partials of all workers and only then divides by the weights, which
+ * gives the same normalization as a rendering in a single process.
+ */
+struct RenderPartial {
+    Vector2i outputSize = Vector2i(0, 0);
+    int borderSize = 0;
+
+    /* How the worker was configured (informative) */
+    uint32_t sampleOffset = 0;
+    uint32_t sampleCount = 0;
+    uint32_t seedOffset = 0;
+    int workerIndex = 0;
+    int workerCount = 1;
+
+    /// Pixels of the whole image (incl. border) as RGB + filter weight
+    std::vector<float> data;
+
+    /// Write the partial to disk (atomically, like \ref RenderCheckpoint::save())
+    void save(const std::string &filename) const;
+
+    /// Read a partial from disk
+    void load(const std::string &filename);
+
+    /// Add the pixels of another partial rendering of the same image
+    void accumulate(const RenderPartial &other);
+
+    /// Divide by the filter weights and return the image (without border)
+    Bitmap *toBitmap() const;
+};
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_CHECKPOINT_H */
@@ -118,6 +118,7 @@ typedef TRay<Point2f, Vector2f> Ray2f;
 typedef TRay<Point3f, Vector3f> Ray3f;
 
 /// Some more forward declarations
+struct AOVRecord;
 class BSDF;
 class Bitmap;
 class BlockGenerator;
@@ -127,6 +128,7 @@ class Integrator;
 class KDTree;
 class Emitter;
 struct EmitterQueryRecord;
+struct Intersection;
 class Shape;
 class NoriObject;
 class NoriObjectFactory;
@@ -0,0 +1,93 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#if !defined(__NORI_DENOISER_H)
+#define __NORI_DENOISER_H
+
+#include <nori/bitmap.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Feature-guided denoiser based on the edge-avoiding a-trous
+ * wavelet transform
+ *
+ * Follows "Edge-Avoiding A-Trous Wavelet Transform for fast Global
+ * Illumination Filtering" by Dammertz et al. (2010), with the variance
+ * guided luminance weight of "Spatiotemporal Variance-Guided Filtering"
+ * by Schied et al. (2017):
+ *
+ * 1. The image is divided by the albedo, so that the filter only
+ *    smoothes the illumination and keeps the texture detail.
+ * 2. A 5x5 B3-spline kernel is applied repeatedly, with holes of
+ *    1, 2, 4, .. pixels between the taps. Every tap is weighted by
+ *    the similarity of the normals and depths, and by the difference
+ *    in luminance relative to its standard deviation. The variance is
+ *    filtered along with the image and thus shrinks every iteration.
+ * 3. The result is multiplied by the albedo again.
+ *
+ * All inputs are bitmaps of the same size, e.g. the AOVs of a rendering
+ * (see \ref AOVRecord). Pixels without a surface have a zero normal and
+ * are only combined with each other.
+ */
+class Denoiser {
+public:
+    /**
+     * \brief Create a denoiser
+     *
+     * \param iterations
+     *    Number of wavelet iterations (the filter covers about
+     *    <tt>2^(iterations+2)</tt> pixels)
+     * \param sigmaLuminance
+     *    Tolerated luminance difference in standard deviations
+     * \param sigmaNormal
+     *    Exponent of the cosine between two normals
+     * \param sigmaDepth
+     *    Tolerated relative depth difference per pixel of distance
+     */
+    Denoiser(int iterations = 5, float sigmaLuminance = 4.0f, float sigmaNormal = 128.0f,
+             float sigmaDepth = 0.05f);
+
+    /**
+     * \brief Denoise an image
+     *
+     * \param color
+     *    The noisy image
+     * \param variance
+     *    Per-pixel variance of \c color (of the estimate, not of the samples)
+     * \param albedo, normal, depth
+     *    Feature buffers of the first surface seen through every pixel
+     * \return
+     *    The filtered image
+     */
+    Bitmap *denoise(const Bitmap &color, const Bitmap &variance, const Bitmap &albedo,
+                    const Bitmap &normal, const Bitmap &depth) const;
+
+    /// Return a human-readable string summary
+    std::string toString() const;
+
+private:
+    int m_iterations;
+    float m_sigmaLuminance;
+    float m_sigmaNormal;
+    float m_sigmaDepth;
+};
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_DENOISER_H */
@@ -24,6 +24,7 @@
 NORI_NAMESPACE_BEGIN
 
 struct Intersection;
+struct LightBounds;
 /**
  * \brief Data record for conveniently querying and sampling the
  * direct illumination technique implemented by a emitter
@@ -103,6 +104,17 @@ public:
     
     virtual bool isEnvEmitter() const { return false; }
 
+    /**
+     * \brief Return the spatial and directional bounds of the emission
+     *
+     * These are used by the \ref LightTree to importance sample
+     * emitters in scenes with many lights.
+     *
+     * \return \c false if the emitter is unbounded (e.g. an environment
+     *         map), in which case \c bounds is left untouched
+     */
+    virtual bool getLightBounds(LightBounds &bounds) const { return false; }
+
     /// Sample a photon
     virtual Color3f samplePhoton(Ray3f &ray, const Point2f &sample1, const Point2f &sample2) const {
         throw NoriException("Emitter::samplePhoton(): not implemented!");
@@ -22,12 +22,13 @@
 #include <nori/common.h>
 #include <nanogui/screen.h>
 #include <nori/render.h>
+#include <nori/bitmap.h>
 
 NORI_NAMESPACE_BEGIN
 
 class NoriScreen : public nanogui::Screen {
 public:
-    NoriScreen(ImageBlock &block);
+    NoriScreen(ImageBlock &block, const RenderOptions &options = RenderOptions());
     virtual ~NoriScreen();
 
     void drawContents();
@@ -48,6 +49,8 @@ private:
     Widget *panel = nullptr;
 
     RenderThread m_renderThread;
+    RenderOptions m_options;
+    Bitmap m_preview;
 };
 
 NORI_NAMESPACE_END
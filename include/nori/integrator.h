@@ -54,6 +54,70 @@ public:
      */
     virtual Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray) const = 0;
 
+    /**
+     * \brief Sample the incident radiance along a camera ray through \c pixel
+     *
+     * This is the entry point used by the renderer. The default
+     * implementation ignores the pixel and calls \ref Li(); integrators
+     * that share information between neighbouring pixels override it.
+     *
+     * \param aov
+     *    If not \c nullptr, the integrator may record the arbitrary output
+     *    variables of the sample along the way (see \ref AOVRecord). The
+     *    default implementation does not.
+     */
+    virtual Color3f LiPixel(const Scene *scene, Sampler *sampler, const Ray3f &ray,
+            const Point2i &pixel, AOVRecord *aov) const {
+        return Li(scene, sampler, ray);
+    }
+
+    /**
+     * \brief Render one sample of every pixel of an image block
+     *
+     * Integrators that advance many paths at once (e.g. in wavefront
+     * order) override this and return \c true. The default returns
+     * \c false, and the renderer then calls \ref LiPixel() for every
+     * pixel of the block. This is also the fallback when the block has
+     * AOV planes that the integrator cannot fill.
+     *
+     * \param sampleIndex
+     *    Index of the pixel sample (see \ref Sampler::startPixelSample())
+     */
+    virtual bool renderBlock(const Scene *scene, Sampler *sampler, ImageBlock &block,
+            uint32_t sampleIndex) const {
+        return false;
+    }
+
+    /**
+     * \brief Notify the integrator that a new pass over the image begins
+     *
+     * Each pass renders one or more samples of every pixel (see
+     * \ref RenderSettings::samplesPerPass). This is called from a single
+     * thread while no pixel of the image is being rendered.
+     */
+    virtual void beginPass(uint32_t pass) { }
+
+    /**
+     * \brief Do the samples of a pass depend on the previous pass?
+     *
+     * Integrators that reuse per-pixel results of the previous pass
+     * (e.g. the reservoirs of ReSTIR) return \c true. The renderer then
+     * renders a single sample of every pixel per pass, so that each
+     * generation of samples builds on the last one.
+     */
+    virtual bool reusesPreviousPass() const { return false; }
+
+    /**
+     * \brief Notify the integrator that a new frame begins
+     *
+     * Called before the first pass of every frame (also when only a single
+     * image is rendered), after \ref preprocess() and after the camera has
+     * moved to the frame. The result of \ref preprocess() is reused by all
+     * frames of a batch, so integrators reset their view-dependent state
+     * here.
+     */
+    virtual void beginFrame(const Scene *scene, uint32_t frame) { }
+
     /**
      * \brief Return the type of object (i.e. Mesh/BSDF/etc.) 
      * provided by this instance
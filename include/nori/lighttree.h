@@ -0,0 +1,142 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob, Romain Prévost
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#if !defined(__NORI_LIGHTTREE_H)
+#define __NORI_LIGHTTREE_H
+
+#include <nori/bbox.h>
+#include <unordered_map>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Spatial and directional bounds of the emission of one or
+ * more emitters
+ *
+ * Besides an axis-aligned bounding box and the emitted power, this
+ * record stores an orientation cone: all surface normals of the
+ * emitter(s) lie within \c cosTheta_o of the axis \c w, and light
+ * leaves the surface within a further \c cosTheta_e of the normal.
+ */
+struct LightBounds {
+    /// Spatial extent of the emitter(s)
+    BoundingBox3f bbox;
+    /// Central axis of the normal cone
+    Vector3f w;
+    /// Emitted power (luminance)
+    float phi = 0.0f;
+    /// Cosine of the spread of the normals around \c w
+    float cosTheta_o = -1.0f;
+    /// Cosine of the emission spread around each normal
+    float cosTheta_e = -1.0f;
+    /// Do the emitter(s) radiate on both sides of the surface?
+    bool twoSided = false;
+
+    /// Create an empty record
+    LightBounds() : w(0.0f, 0.0f, 1.0f) { }
+
+    /**
+     * \brief Conservative estimate of the contribution of the emitter(s)
+     * to the point \c p with the surface normal \c n
+     *
+     * A zero normal (e.g. for a scattering event inside a medium)
+     * disables the cosine term at the receiver.
+     */
+    float importance(const Point3f &p, const Normal3f &n) const;
+
+    /// Return the union of two bounds
+    static LightBounds merge(const LightBounds &a, const LightBounds &b);
+
+    /// Return a human-readable string summary
+    std::string toString() const;
+};
+
+/**
+ * \brief Light hierarchy for many-light sampling
+ *
+ * This class builds a binary tree over the bounded emitters of a scene,
+ * storing \ref LightBounds (extent, power, orientation cone) in each
+ * node. An emitter is selected by stochastically descending the tree,
+ * choosing each child proportionally to its \ref LightBounds::importance()
+ * with respect to the shading point. Unbounded emitters (environment maps)
+ * are not part of the tree and are sampled uniformly with a separate
+ * probability.
+ *
+ * The tree is built using the surface area orientation heuristic
+ * described in
+ *
+ * "Importance Sampling of Many Lights with Adaptive Tree Splitting"
+ * by Alejandro Conty Estevez and Christopher Kulla (HPG 2018)
+ */
+class LightTree {
+public:
+    /// Create an empty light tree
+    LightTree() { }
+
+    /// Build the tree over the given list of emitters
+    void build(const std::vector<Emitter *> &emitters);
+
+    /// Release all memory
+    void clear();
+
+    /**
+     * \brief Select an emitter for the shading point \c p with normal \c n
+     *
+     * \param sample
+     *     A uniformly distributed sample on [0,1]
+     * \param pdf
+     *     Upon success, the discrete probability of the selection
+     * \return
+     *     The selected emitter, or \c nullptr if no emitter
+     *     contributes to the shading point
+     */
+    const Emitter *sample(const Point3f &p, const Normal3f &n,
+        float sample, float &pdf) const;
+
+    /// Return the probability that \ref sample() selects \c emitter
+    float pdf(const Point3f &p, const Normal3f &n, const Emitter *emitter) const;
+
+    /// Return the number of emitters handled by the tree
+    size_t getEmitterCount() const { return m_emitters.size() + m_infinite.size(); }
+
+    /// Return a human-readable string summary
+    std::string toString() const;
+protected:
+    /// Recursively build the subtree for the emitters in [start, end)
+    uint32_t buildRecursive(std::vector<std::pair<const Emitter *, LightBounds>> &lights,
+        uint32_t start, uint32_t end, uint64_t bitTrail, int depth);
+
+    /// Probability of picking one of the unbounded emitters
+    float infiniteProbability() const;
+
+    struct LightNode {
+        LightBounds bounds;
+        /// Index of the right child (inner node) or the emitter (leaf)
+        uint32_t index;
+        bool leaf;
+    };
+private:
+    std::vector<LightNode> m_nodes;              ///< Tree nodes, left child follows its parent
+    std::vector<const Emitter *> m_emitters;     ///< Emitters referenced by the leaves
+    std::vector<const Emitter *> m_infinite;     ///< Unbounded emitters
+    std::unordered_map<const Emitter *, uint64_t> m_bitTrails; ///< Root-to-leaf path of every emitter
+};
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_LIGHTTREE_H */
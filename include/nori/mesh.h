@@ -89,6 +89,12 @@ public:
     /// Return the surface area of the given triangle
     float surfaceArea(uint32_t index) const;
 
+    /// Return the total surface area of the mesh
+    virtual float getSurfaceArea() const override { return m_pdf.getSum(); }
+
+    /// Compute a cone that bounds the normals of all triangles
+    virtual void getNormalBounds(Vector3f &axis, float &cosTheta) const override;
+
     Point3f getInterpolatedVertex(uint32_t index, const Vector3f & bc) const;
     Normal3f getInterpolatedNormal(uint32_t index, const Vector3f & bc) const;
 
@@ -0,0 +1,176 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#if !defined(__NORI_QMC_H)
+#define __NORI_QMC_H
+
+#include <nori/vector.h>
+
+/// Largest float below one
+#define NORI_ONE_MINUS_EPSILON 0.99999994f
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Hashing and scrambling building blocks of the
+ * quasi-Monte Carlo samplers
+ *
+ * All functions are pure, so that the samplers can compute every value
+ * from the pixel, sample index and dimension without keeping state.
+ */
+class QMC {
+public:
+    /// Finalizer of MurmurHash3 (a bijective 64-bit mixing function)
+    static uint64_t mixBits(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    /// Combine a hash with another value
+    static uint64_t hash(uint64_t seed, uint64_t value) {
+        return mixBits(seed ^ (value + 0x9E3779B97F4A7C15ull + (seed << 6) + (seed >> 2)));
+    }
+
+    /// Hash a pixel, a dimension and a seed
+    static uint64_t hash(const Point2i &pixel, uint32_t dimension, uint32_t seed) {
+        uint64_t key = mixBits(((uint64_t) (uint32_t) pixel.x() << 32) | (uint32_t) pixel.y());
+        return hash(hash(key, dimension), seed);
+    }
+
+    /// Map the 24 most significant bits of a 32-bit value to a float in [0, 1)
+    static float toFloat(uint32_t v) {
+        return (float) (v >> 8) * (1.0f / 16777216.0f);
+    }
+
+    /// Map the 24 most significant bits of a 64-bit hash to a float in [0, 1)
+    static float toFloat(uint64_t h) {
+        return (float) (h >> 40) * (1.0f / 16777216.0f);
+    }
+
+    /// Reverse the order of the bits of a 32-bit integer
+    static uint32_t reverseBits(uint32_t v) {
+        v = ((v >> 1) & 0x55555555u) | ((v & 0x55555555u) << 1);
+        v = ((v >> 2) & 0x33333333u) | ((v & 0x33333333u) << 2);
+        v = ((v >> 4) & 0x0F0F0F0Fu) | ((v & 0x0F0F0F0Fu) << 4);
+        v = ((v >> 8) & 0x00FF00FFu) | ((v & 0x00FF00FFu) << 8);
+        return (v >> 16) | (v << 16);
+    }
+
+    /**
+     * \brief Owen scrambling of a binary fraction (stored in the
+     * 32 bits of \c v) using the hash-based permutation of
+     * "Practical Hash-based Owen Scrambling" by Brent Burley (JCGT 2020)
+     */
+    static uint32_t owenScramble(uint32_t v, uint32_t seed) {
+        v = reverseBits(v);
+        v += seed;
+        v ^= v * 0x6c50b47cu;
+        v ^= v * 0xb82f1e52u;
+        v ^= v * 0xc7afe638u;
+        v ^= v * 0x8d22f6e6u;
+        return reverseBits(v);
+    }
+
+    /// First two dimensions of the Sobol sequence as 32-bit fractions
+    static uint32_t sobol(uint64_t index, int dimension) {
+        if (dimension == 0)
+            return reverseBits((uint32_t) index);
+        uint32_t result = 0;
+        for (uint32_t v = 1u << 31; index != 0; index >>= 1, v ^= v >> 1) {
+            if (index & 1)
+                result ^= v;
+        }
+        return result;
+    }
+
+    /// Interleave the bits of two 32-bit integers (Morton / Z-order curve)
+    static uint64_t encodeMorton2(uint32_t x, uint32_t y) {
+        return spreadBits(x) | (spreadBits(y) << 1);
+    }
+
+    /// Insert a zero bit after each bit of a 32-bit integer
+    static uint64_t spreadBits(uint64_t v) {
+        v = (v | (v << 16)) & 0x0000FFFF0000FFFFull;
+        v = (v | (v << 8))  & 0x00FF00FF00FF00FFull;
+        v = (v | (v << 4))  & 0x0F0F0F0F0F0F0F0Full;
+        v = (v | (v << 2))  & 0x3333333333333333ull;
+        v = (v | (v << 1))  & 0x5555555555555555ull;
+        return v;
+    }
+
+    /**
+     * \brief Return element \c i of a random permutation of [0, n)
+     * that is selected by the seed \c p
+     *
+     * From "Correlated Multi-Jittered Sampling" by Andrew Kensler (2013)
+     */
+    static uint32_t permutationElement(uint32_t i, uint32_t n, uint32_t p) {
+        uint32_t w = n - 1;
+        w |= w >> 1;
+        w |= w >> 2;
+        w |= w >> 4;
+        w |= w >> 8;
+        w |= w >> 16;
+        do {
+            i ^= p; i *= 0xe170893d;
+            i ^= p >> 16;
+            i ^= (i & w) >> 4;
+            i ^= p >> 8; i *= 0x0929eb3f;
+            i ^= p >> 23;
+            i ^= (i & w) >> 1; i *= 1 | p >> 27;
+            i *= 0x6935fa69;
+            i ^= (i & w) >> 11; i *= 0x74dcb303;
+            i ^= (i & w) >> 2; i *= 0x9e501cc3;
+            i ^= (i & w) >> 2; i *= 0xc860a3df;
+            i &= w;
+            i ^= i >> 5;
+        } while (i >= n);
+        return (i + p) % n;
+    }
+
+    /**
+     * \brief Radical inverse of \c index in the given prime base,
+     * with Owen scrambling of the digits
+     *
+     * The permutation of each digit is selected by hashing \c seed with
+     * all previous digits, and digits are produced until the float
+     * precision is exhausted (the scrambled trailing zeros matter).
+     */
+    static float owenScrambledRadicalInverse(uint32_t base, uint64_t index, uint64_t seed) {
+        float invBase = 1.0f / base, invBaseM = 1.0f;
+        uint64_t reversedDigits = 0;
+        while (1.0f - (base - 1) * invBaseM < 1.0f) {
+            uint64_t next = index / base;
+            uint32_t digit = (uint32_t) (index - next * base);
+            uint32_t digitHash = (uint32_t) mixBits(seed ^ reversedDigits);
+            digit = permutationElement(digit, base, digitHash);
+            reversedDigits = reversedDigits * base + digit;
+            invBaseM *= invBase;
+            index = next;
+        }
+        return std::min(invBaseM * reversedDigits, NORI_ONE_MINUS_EPSILON);
+    }
+};
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_QMC_H */
@@ -23,28 +23,176 @@
 #include <thread>
 #include <nori/block.h>
 #include <atomic>
+#include <memory>
 
 NORI_NAMESPACE_BEGIN
 
+class ThreadArena;
+struct RenderCheckpoint;
+
+/**
+ * \brief Settings of one rendering (e.g. given on the command line)
+ *
+ * Some of them override the \ref RenderSettings of the scene description
+ * (see \ref RenderSettings::applyOverrides()). Zero/empty values keep
+ * the scene's settings.
+ */
+struct RenderOptions {
+    /// Number of worker threads (0: one per core)
+    int threads = 0;
+    /// Only run on the CPUs of this NUMA node (-1: keep the scene's setting)
+    int numaNode = -1;
+    /// Pin every thread to a single CPU
+    bool pinThreads = false;
+    /// Samples per pixel
+    int sampleCount = 0;
+    /// Resolution of the output image
+    Vector2i resolution = Vector2i(0, 0);
+    /// Upper left corner of the rendered region
+    Point2i cropOffset = Point2i(0, 0);
+    /// Size of the rendered region (0: the whole image)
+    Vector2i cropSize = Vector2i(0, 0);
+    /// Only save the rendered region instead of a full-size image
+    bool cropOutput = false;
+    /// Name of the output EXR file (default: scene name with ".exr")
+    std::string outputName;
+    /// Wall-clock time budget in seconds
+    float timeBudget = 0.f;
+    /// File that periodically receives a checkpoint (empty: no checkpoints)
+    std::string checkpointName;
+    /// Minimum time between two checkpoints in seconds
+    float checkpointInterval = 60.f;
+    /// Continue from the checkpoint file if it exists
+    bool resume = false;
+    /// File that periodically receives the image in progress (empty: no snapshots)
+    std::string snapshotName;
+    /// Time between two snapshots in seconds (0: only count passes)
+    float snapshotInterval = 10.f;
+    /// Number of passes between two snapshots (0: only use the interval)
+    int snapshotPasses = 0;
+    /// Write the unnormalized accumulation to this file instead of an EXR (see nori-merge)
+    std::string partialName;
+    /// Only render the tiles whose index modulo \c workerCount is \c workerIndex
+    int workerIndex = 0;
+    int workerCount = 1;
+    /// Index of the first pixel sample
+    uint32_t sampleOffset = 0;
+    /// Offset of the sampler's seed
+    uint32_t seedOffset = 0;
+    /// Number of frames of a batch rendering (0: the scene's setting)
+    int frames = 0;
+    /// Orbit the camera around the scene over the frames
+    bool turntable = false;
+    /// Comma-separated list of AOVs (e.g. "albedo,normal"; see \ref AOVRecord)
+    std::string aovs;
+    /// Denoise the image after rendering
+    bool denoise = false;
+};
+
+/// Summary of a finished rendering
+struct RenderStatistics {
+    /// Name of the written image (of the last frame of a batch)
+    std::string outputName;
+    /// Size of the output image
+    Vector2i size = Vector2i(0, 0);
+    /// Number of worker threads
+    int threads = 0;
+    /// Samples per pixel (averaged over the rendered region)
+    float samplesPerPixel = 0.f;
+    /// Time needed to load and preprocess the scene (in seconds)
+    double loadTime = 0;
+    /// Time spent in the render loop (in seconds, summed over all frames)
+    double renderTime = 0;
+    /// Number of frames of a batch rendering
+    int frames = 1;
+    /// Time spent in the render loop for every frame (in seconds)
+    std::vector<double> frameTimes;
+    /// Time spent denoising (in seconds, summed over all frames)
+    double denoiseTime = 0;
+    /// Number of negative, NaN or infinite samples that were discarded (see \ref RenderSettings::checkSamples)
+    uint64_t invalidSamples = 0;
+    /// Number of snapshots of the image in progress that were written
+    uint32_t snapshots = 0;
+
+    /// Samples per pixel that a tile received
+    struct Tile {
+        Point2i offset;
+        Vector2i size;
+        uint32_t samples;
+    };
+    std::vector<Tile> tiles;
+    /// Were all frames rendered and saved without errors or an abort?
+    bool success = false;
+};
+
 class RenderThread {
 
 public:
     RenderThread(ImageBlock & block);
     ~RenderThread();
 
-    void renderScene(const std::string & filename);
+    void renderScene(const std::string & filename,
+                     const RenderOptions &options = RenderOptions());
 
     bool isBusy();
     void stopRendering();
 
+    /**
+     * \brief Ask the current rendering to stop without waiting for it
+     *
+     * The rendering then saves its progress and reports a failure. Only
+     * touches an atomic, so it may be called from a signal handler.
+     */
+    void requestStop();
+
+    /// Block until the current rendering has finished
+    void wait();
+
     float getProgress();
 
+    /// Return a summary of the last rendering (valid once it has finished)
+    const RenderStatistics &getStatistics() const { return m_statistics; }
+
+    /**
+     * \brief Denoise the progress image after every pass (for display)
+     *
+     * Only takes effect for scenes that are denoised (see
+     * \ref RenderSettings::denoise).
+     */
+    void setDenoisePreview(bool enabled) { m_denoisePreview = enabled; }
+
+    /// Are denoised previews enabled?
+    bool getDenoisePreview() const { return m_denoisePreview; }
+
+    /**
+     * \brief Copy the latest denoised preview of the whole image
+     *
+     * \return \c false if there is none (yet)
+     */
+    bool getDenoisedPreview(Bitmap &bitmap);
+
 protected:
     Scene* m_scene = nullptr;
     ImageBlock & m_block;
     std::thread m_render_thread;
     std::atomic<int> m_render_status; // 0: free, 1: busy, 2: interruption, 3: done
     std::atomic<float> m_progress;
+    RenderStatistics m_statistics;
+    std::unique_ptr<ThreadArena> m_arena;
+    std::atomic<bool> m_denoisePreview;
+    std::unique_ptr<Bitmap> m_preview;
+    tbb::mutex m_previewMutex;
+
+    /// Settings of a rendering that all of its frames share
+    struct Job;
+
+    /**
+     * \brief Render one frame of the current scene and save it
+     *
+     * Runs in the thread arena. \c resumed is the checkpoint to continue
+     * from (or \c nullptr).
+     */
+    void renderFrame(const Job &job, uint32_t frame, const RenderCheckpoint *resumed);
 
 };
 
@@ -89,15 +89,75 @@ public:
     /// Advance to the next sample
     virtual void advance() = 0;
 
+    /**
+     * \brief Start generating the sample with index \c sampleIndex
+     * of the given pixel
+     *
+     * This function is called by the renderer before every camera ray.
+     * Samplers whose values are a function of the pixel and sample index
+     * use it to select the sample; the default implementation ignores it.
+     * Integrators that interleave many paths use \c dimension to resume
+     * a sample at the first component that it has not consumed yet.
+     */
+    virtual void startPixelSample(const Point2i &pixel, uint32_t sampleIndex,
+            uint32_t dimension = 0) { }
+
     /// Retrieve the next component value from the current sample
     virtual float next1D() = 0;
 
     /// Retrieve the next two component values from the current sample
     virtual Point2f next2D() = 0;
 
+    /**
+     * \brief Retrieve the next \c count component values from the
+     * current sample
+     *
+     * Equivalent to \c count calls of \ref next1D(), but costs a single
+     * virtual call. Samplers derived from \ref SamplerImpl override it
+     * with a loop over their own (statically dispatched and inlined)
+     * generator.
+     */
+    virtual void next1DArray(float *values, size_t count) {
+        for (size_t i = 0; i < count; ++i)
+            values[i] = next1D();
+    }
+
+    /// Retrieve the next \c count pairs of component values (equivalent to \c count calls of \ref next2D())
+    virtual void next2DArray(Point2f *values, size_t count) {
+        for (size_t i = 0; i < count; ++i)
+            values[i] = next2D();
+    }
+
     /// Return the number of configured pixel samples
     virtual size_t getSampleCount() const { return m_sampleCount; }
 
+    /// Override the number of pixel samples (e.g. from the command line)
+    virtual void setSampleCount(size_t sampleCount) { m_sampleCount = sampleCount; }
+
+    /**
+     * \brief Offset the seed of the sampler
+     *
+     * Workers of a distributed rendering that render the same pixels
+     * use different offsets so that they draw different samples. An
+     * offset of zero leaves the samples unchanged.
+     */
+    void setSeedOffset(uint32_t seedOffset) { m_seedOffset = seedOffset; }
+
+    /**
+     * \brief Write the current state of the sampler to a stream
+     *
+     * Used by checkpoints: a sampler that is restored using \ref
+     * unserialize() must continue with exactly the same samples.
+     */
+    virtual void serialize(std::ostream &stream) const {
+        throw NoriException("Sampler: checkpoints are not supported by %s!", toString());
+    }
+
+    /// Restore a state written by \ref serialize()
+    virtual void unserialize(std::istream &stream) {
+        throw NoriException("Sampler: checkpoints are not supported by %s!", toString());
+    }
+
     /**
      * \brief Return the type of object (i.e. Mesh/Sampler/etc.) 
      * provided by this instance
@@ -105,6 +165,30 @@ public:
     virtual EClassType getClassType() const override { return ESampler; }
 protected:
     size_t m_sampleCount;
+    uint32_t m_seedOffset = 0;
+};
+
+/**
+ * \brief Base class of concrete samplers that provides the array
+ * versions of \ref Sampler::next1D() and \ref Sampler::next2D()
+ *
+ * Uses the curiously recurring template pattern: the loops call the
+ * generator of \c Derived without virtual dispatch, so that it can be
+ * inlined.
+ */
+template <typename Derived> class SamplerImpl : public Sampler {
+public:
+    virtual void next1DArray(float *values, size_t count) override {
+        Derived *sampler = static_cast<Derived *>(this);
+        for (size_t i = 0; i < count; ++i)
+            values[i] = sampler->Derived::next1D();
+    }
+
+    virtual void next2DArray(Point2f *values, size_t count) override {
+        Derived *sampler = static_cast<Derived *>(this);
+        for (size_t i = 0; i < count; ++i)
+            values[i] = sampler->Derived::next2D();
+    }
 };
 
 NORI_NAMESPACE_END
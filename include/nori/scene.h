@@ -22,6 +22,9 @@
 #include <nori/bvh.h>
 #include <nori/emitter.h>
 #include <nori/medium.h>
+#include <nori/lighttree.h>
+#include <atomic>
+#include <mutex>
 
 NORI_NAMESPACE_BEGIN
 
@@ -52,6 +55,9 @@ public:
     /// Return a pointer to the scene's camera
     const Camera *getCamera() const { return m_camera; }
 
+    /// Return a pointer to the scene's camera
+    Camera *getCamera() { return m_camera; }
+
     /// Return a pointer to the scene's sample generator (const version)
     const Sampler *getSampler() const { return m_sampler; }
 
@@ -64,10 +70,10 @@ public:
     /// Return a reference to an array containing all lights
     const std::vector<Emitter *> &getLights() const { return m_emitters; }
     
-    // Return a reference to the environment map emitter
-    const Emitter* &getEnvEmitter() const {
+    /// Return the environment map emitter (or \c nullptr if there is none)
+    const Emitter *getEnvEmitter() const {
         const Emitter* ptr = nullptr;
-        for (int i = 0; i < m_emitters.size(); ++i) {
+        for (size_t i = 0; i < m_emitters.size(); ++i) {
             if (m_emitters[i]->isEnvEmitter()) ptr = m_emitters[i];
         }
         return ptr;
@@ -81,9 +87,73 @@ public:
                 n-1);
         return m_emitters[index];
     }
+
+    /**
+     * \brief Select an emitter for next event estimation at the
+     * point \c p with surface normal \c n
+     *
+     * Depending on the scene's \c lightSampler setting, the emitter is
+     * either chosen uniformly or by traversing the \ref LightTree.
+     *
+     * \param rnd
+     *     A uniformly distributed sample on [0,1]
+     * \param pdf
+     *     The discrete probability of the selected emitter
+     * \return
+     *     The selected emitter, or \c nullptr if none contributes
+     */
+    const Emitter *sampleEmitter(const Point3f &p, const Normal3f &n,
+            float rnd, float &pdf) const {
+        if (m_useLightTree)
+            return m_lightTree.sample(p, n, rnd, pdf);
+        pdf = 1.0f / m_emitters.size();
+        return getRandomEmitter(rnd);
+    }
+
+    /// Return the probability that \ref sampleEmitter() selects \c emitter
+    float pdfEmitter(const Point3f &p, const Normal3f &n, const Emitter *emitter) const {
+        if (m_useLightTree)
+            return m_lightTree.pdf(p, n, emitter);
+        return 1.0f / m_emitters.size();
+    }
     
     const Medium *getMedium() const { return m_medium; }
 
+    /**
+     * \brief Return the properties of the scene description
+     *
+     * Apart from \c lightSampler, they hold the renderer and job
+     * configuration, which the renderer parses (see \ref RenderSettings).
+     */
+    const PropertyList &getProperties() const { return m_properties; }
+
+    /// Return the number of cameras of the scene description (the keys of \ref setFrame())
+    uint32_t getCameraCount() const { return (uint32_t) m_cameraKeys.size(); }
+
+    /**
+     * \brief Move the camera to the position of a frame of a batch
+     * rendering with \c frameCount frames
+     *
+     * Every camera of the scene description is a key: the first one is
+     * used for rendering, the others only provide their transformation.
+     * With as many frames as keys, each frame uses one key; otherwise the
+     * frames are spread evenly over the path through the keys, and the
+     * camera is interpolated in between. A turntable instead orbits the
+     * first camera around the center of the scene (about the camera's up
+     * axis), in equal steps over a full turn.
+     */
+    void setFrame(uint32_t frame, uint32_t frameCount, bool turntable);
+
+    /**
+     * \brief Build the BVH over all shapes (unless it already exists)
+     *
+     * Not part of \ref activate(): the renderer calls it from within the
+     * \ref ThreadArena of the rendering, so that the parallel build only
+     * uses the configured threads. Otherwise, the first ray traced
+     * against the scene builds it.
+     */
+    void buildBVH() const;
+
     /**
      * \brief Intersect a ray against all triangles stored in the scene
      * and return detailed intersection information
@@ -99,6 +169,8 @@ public:
      * \return \c true if an intersection was found
      */
     bool rayIntersect(const Ray3f &ray, Intersection &its) const {
+        if (!m_bvhBuilt.load(std::memory_order_acquire))
+            buildBVH();
         return m_bvh->rayIntersect(ray, its, false);
     }
 
@@ -119,6 +191,8 @@ public:
      */
     bool rayIntersect(const Ray3f &ray) const {
         Intersection its; /* Unused */
+        if (!m_bvhBuilt.load(std::memory_order_acquire))
+            buildBVH();
         return m_bvh->rayIntersect(ray, its, true);
     }
 
@@ -132,8 +206,8 @@ public:
     /**
      * \brief Inherited from \ref NoriObject::activate()
      *
-     * Initializes the internal data structures (kd-tree,
-     * emitter sampling data structures, etc.)
+     * Initializes the emitter sampling data structures. The BVH is
+     * built separately by \ref buildBVH().
      */
     virtual void activate() override;
 
@@ -150,9 +224,17 @@ private:
     Sampler *m_sampler = nullptr;
     Camera *m_camera = nullptr;
     BVH *m_bvh = nullptr;
+    mutable std::atomic<bool> m_bvhBuilt;
+    mutable std::mutex m_bvhMutex;
 
     Medium *m_medium = nullptr;
     std::vector<Emitter *> m_emitters;
+
+    bool m_useLightTree = false;
+    LightTree m_lightTree;
+    PropertyList m_properties;
+    std::vector<Transform> m_cameraKeys;
+    std::vector<Camera *> m_keyCameras;
 };
 
 NORI_NAMESPACE_END
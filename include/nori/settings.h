@@ -0,0 +1,191 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#if !defined(__NORI_SETTINGS_H)
+#define __NORI_SETTINGS_H
+
+#include <nori/block.h>
+#include <nori/aov.h>
+#include <nori/proplist.h>
+
+NORI_NAMESPACE_BEGIN
+
+struct RenderOptions;
+
+/**
+ * \brief Renderer and job configuration of a rendering
+ *
+ * The scene description specifies these settings as properties of its
+ * \c scene element (e.g. <tt>&lt;integer name="samplesPerPass"
+ * value="4"/&gt;</tt>). The \ref Scene itself ignores them: the renderer
+ * parses them once from \ref Scene::getProperties() and then applies
+ * the overrides of the command line (see \ref RenderOptions).
+ */
+struct RenderSettings {
+    /**
+     * \brief Number of samples per pixel that the renderer computes for
+     * a tile before merging it into the image
+     *
+     * The default (1) refreshes the whole image after every sample.
+     * Larger values reduce synchronization and keep the per-tile state
+     * in cache. 0 selects an adaptive schedule that starts with single
+     * samples and doubles the pass size after every pass.
+     */
+    int samplesPerPass = 1;
+
+    /**
+     * \brief Error threshold of adaptive sampling
+     *
+     * Tiles whose estimated relative error falls below this value stop
+     * receiving samples, and the spared budget goes to the remaining
+     * tiles. 0 (the default) disables adaptive sampling.
+     */
+    float adaptiveThreshold = 0.0f;
+
+    /**
+     * \brief Maximum number of samples per pixel that adaptive sampling
+     * may spend on a single tile
+     *
+     * 0 (the default) stands for four times the sample count of the
+     * scene's sampler (see \ref getMaxSampleCount()).
+     */
+    uint32_t maxSampleCount = 0;
+
+    /**
+     * \brief Wall-clock budget of a rendering in seconds
+     *
+     * When set, the renderer ignores the sampler's sample count and keeps
+     * adding passes as long as they are expected to finish before the
+     * deadline (measured from the start of scene loading). The budget
+     * does not include the time needed to save the image. 0 (the
+     * default) disables the budget.
+     */
+    float timeBudget = 0.0f;
+
+    /**
+     * \brief Size of the blocks (tiles) that the renderer distributes
+     * among the threads
+     *
+     * 0 (the default) selects the size automatically from the image
+     * size, the number of threads and the reconstruction filter (see
+     * \ref BlockGenerator::optimalBlockSize()).
+     */
+    int blockSize = 0;
+
+    /// Order in which the blocks are rendered
+    BlockGenerator::EOrder blockOrder = BlockGenerator::ESpiral;
+
+    /// Upper left corner of the crop window (in pixels)
+    Point2i cropOffset = Point2i(0, 0);
+
+    /**
+     * \brief Size of the crop window in pixels
+     *
+     * Only the pixels of the crop window are rendered. A zero size (the
+     * default) renders the whole image.
+     */
+    Vector2i cropSize = Vector2i(0, 0);
+
+    /// Only save the crop window instead of a full-size image that is black outside of it
+    bool cropOutput = false;
+
+    /**
+     * \brief Arbitrary output variables that are rendered along with the
+     * image (see \ref AOVRecord)
+     *
+     * They are saved as additional layers of the output EXR file, in
+     * the order of the \c aovs property (e.g. "albedo,normal,depth").
+     */
+    std::vector<AOVRecord::EType> aovs;
+
+    /**
+     * \brief Denoise the image after rendering
+     *
+     * The denoiser (see \ref Denoiser) is guided by the albedo, normal,
+     * depth and variance AOVs, which are then rendered as well.
+     */
+    bool denoise = false;
+
+    /// Number of iterations of the denoiser
+    int denoiseIterations = 5;
+
+    /**
+     * \brief Number of threads that render the scene
+     *
+     * 0 (the default) uses one thread per core (or per CPU of the NUMA
+     * node, see \ref numaNode).
+     */
+    int threads = 0;
+
+    /// NUMA node whose CPUs render the scene (-1: all CPUs)
+    int numaNode = -1;
+
+    /// Pin every render thread to a single CPU
+    bool pinThreads = false;
+
+    /**
+     * \brief Number of frames of a batch rendering
+     *
+     * The scene is loaded once and then rendered from a sequence of
+     * camera positions (see \ref Scene::setFrame()). 0 (the default)
+     * stands for one frame per camera of the scene description (see
+     * \ref getFrameCount()).
+     */
+    uint32_t frames = 0;
+
+    /// Orbit the camera around the scene instead of following the camera keys
+    bool turntable = false;
+
+    /**
+     * \brief Discard and count invalid (negative, NaN or infinite)
+     * samples
+     *
+     * Enabled by default. Disabling it saves a test per sample (see
+     * \ref ImageBlock::setSampleCheck()) for integrators that are
+     * known to be robust.
+     */
+    bool checkSamples = true;
+
+    /// Create the default settings
+    RenderSettings() { }
+
+    /// Parse the settings from the properties of a scene description
+    explicit RenderSettings(const PropertyList &props);
+
+    /// Replace the settings that the command line overrides
+    void applyOverrides(const RenderOptions &options);
+
+    /// Return \ref maxSampleCount, or its default for a sampler with \c sampleCount samples
+    uint32_t getMaxSampleCount(uint32_t sampleCount) const {
+        return maxSampleCount > 0 ? maxSampleCount : 4 * sampleCount;
+    }
+
+    /// Return \ref frames, or its default for a scene with \c cameraCount cameras
+    uint32_t getFrameCount(uint32_t cameraCount) const {
+        if (frames > 0)
+            return frames;
+        return turntable ? 1 : cameraCount;
+    }
+
+    /// Return a human-readable summary
+    std::string toString() const;
+};
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_SETTINGS_H */
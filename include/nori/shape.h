@@ -120,6 +120,24 @@ public:
     const BSDF *getBSDF() const { return m_bsdf; }
 
 
+    /// Return the total surface area of the shape
+    virtual float getSurfaceArea() const = 0;
+
+    /**
+     * \brief Compute a cone that bounds all surface normals of the shape
+     *
+     * The default implementation returns the entire sphere of directions.
+     *
+     * \param axis
+     *     Central axis of the cone
+     * \param cosTheta
+     *     Cosine of the cone's half-angle
+     */
+    virtual void getNormalBounds(Vector3f &axis, float &cosTheta) const {
+        axis = Vector3f(0.0f, 0.0f, 1.0f);
+        cosTheta = -1.0f;
+    }
+
     /// Return the total number of primitives in this shape
     virtual uint32_t getPrimitiveCount() const { return 1; }
 
@@ -0,0 +1,95 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#if !defined(__NORI_SNAPSHOT_H)
+#define __NORI_SNAPSHOT_H
+
+#include <nori/block.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Background writer for snapshots of an in-progress rendering
+ *
+ * The render loop hands the accumulation buffer of the image block to
+ * \ref submit(), which only copies the pixels into a back buffer. A
+ * background thread swaps it with its front buffer, normalizes the
+ * pixels and writes the file, so the renderer never waits for the disk.
+ * If the thread is still busy when the next snapshot arrives, the
+ * pending one is replaced (only the latest progress is written).
+ *
+ * Files ending in ".png" are saved as 8-bit sRGB images, all others as
+ * OpenEXR. Every snapshot is written to a temporary file that then
+ * replaces the target, so readers never see a partially written file.
+ */
+class SnapshotWriter {
+public:
+    /// Start the background thread
+    SnapshotWriter();
+
+    /// Calls \ref stop()
+    ~SnapshotWriter();
+
+    /**
+     * \brief Submit a snapshot of a region of an image block
+     *
+     * The caller locks the block. The arguments match those of
+     * \ref ImageBlock::toBitmap().
+     *
+     * \param filename
+     *    Name of the written file
+     */
+    void submit(const ImageBlock &block, const Point2i &offset, const Vector2i &size,
+                bool crop, const std::string &filename);
+
+    /**
+     * \brief Write the pending snapshot (if any) and stop the
+     * background thread
+     */
+    void stop();
+
+    /// Return the number of snapshots that have been written so far
+    uint32_t getWrittenCount() const { return m_written; }
+
+private:
+    /// Unnormalized pixels of a snapshot and where they go
+    struct Buffer {
+        ImageBlock::Plane pixels;
+        Point2i origin;
+        Vector2i imageSize;
+        std::string filename;
+    };
+
+    void run();
+
+    Buffer m_front, m_back;
+    bool m_pending = false;
+    bool m_stop = false;
+    std::atomic<uint32_t> m_written;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::thread m_thread;
+};
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_SNAPSHOT_H */
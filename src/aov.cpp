@@ -0,0 +1,77 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <nori/aov.h>
+#include <nori/shape.h>
+#include <nori/bsdf.h>
+#include <algorithm>
+
+NORI_NAMESPACE_BEGIN
+
+static const char *aovNames[AOVRecord::ETypeCount] = {
+    "albedo", "normal", "depth", "position", "direct", "indirect", "variance", "sampleCount"
+};
+
+static const char *aovChannels[AOVRecord::ETypeCount] = {
+    "RGB", "XYZ", "Z", "XYZ", "RGB", "RGB", "RGB", "Y"
+};
+
+void AOVRecord::setSurface(const Intersection *its) {
+    if (its) {
+        const BSDF *bsdf = its->mesh->getBSDF();
+        values[EAlbedo] = bsdf ? bsdf->getAlbedo(its->uv) : Color3f(0.0f);
+        values[ENormal] = Color3f(its->shFrame.n.x(), its->shFrame.n.y(), its->shFrame.n.z());
+        values[EDepth] = Color3f(its->t);
+        values[EPosition] = Color3f(its->p.x(), its->p.y(), its->p.z());
+    } else {
+        values[EAlbedo] = values[ENormal] = values[EDepth] = values[EPosition] = Color3f(0.0f);
+    }
+    hasSurface = true;
+}
+
+AOVRecord::EType AOVRecord::typeFromString(const std::string &name) {
+    for (int i = 0; i < ETypeCount; ++i) {
+        if (toLower(name) == toLower(aovNames[i]))
+            return (EType) i;
+    }
+    throw NoriException("Unknown AOV \"%s\" (expected one of albedo, normal, depth, "
+                        "position, direct, indirect, variance, sampleCount)!", name);
+}
+
+std::vector<AOVRecord::EType> AOVRecord::parseList(const std::string &list) {
+    std::vector<EType> result;
+    if (list.empty())
+        return result;
+    for (const std::string &name : tokenize(list, ", ")) {
+        EType type = typeFromString(name);
+        if (std::find(result.begin(), result.end(), type) != result.end())
+            throw NoriException("The AOV \"%s\" was requested twice!", name);
+        result.push_back(type);
+    }
+    return result;
+}
+
+std::string AOVRecord::typeName(EType type) {
+    return aovNames[type];
+}
+
+const char *AOVRecord::channelNames(EType type) {
+    return aovChannels[type];
+}
+
+NORI_NAMESPACE_END
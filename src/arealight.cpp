@@ -19,6 +19,7 @@
 #include <nori/emitter.h>
 #include <nori/warp.h>
 #include <nori/shape.h>
+#include <nori/lighttree.h>
 
 NORI_NAMESPACE_BEGIN
 
@@ -80,6 +81,17 @@ public:
         return m_shape->pdfSurface(sRec)*(lRec.p-lRec.ref).squaredNorm()/cosTheta;
     }
 
+    /// One-sided cosine emission from the surface of the attached shape
+    virtual bool getLightBounds(LightBounds &bounds) const override {
+        if(!m_shape) {
+            throw NoriException("There is no shape attached to this Area light!");
+        }
+        bounds.bbox = m_shape->getBoundingBox();
+        bounds.phi = M_PI * m_radiance.getLuminance() * m_shape->getSurfaceArea();
+        m_shape->getNormalBounds(bounds.w, bounds.cosTheta_o);
+        bounds.cosTheta_e = 0.0f;
+        return true;
+    }
 
     virtual Color3f samplePhoton(Ray3f &ray, const Point2f &sample1, const Point2f &sample2) const override {
         
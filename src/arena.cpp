@@ -0,0 +1,161 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Observers that are local to a task_arena are a preview feature of TBB 4.x */
+#define TBB_PREVIEW_LOCAL_OBSERVER 1
+
+#include <nori/arena.h>
+#include <tbb/task_scheduler_init.h>
+#include <tbb/task_scheduler_observer.h>
+#include <algorithm>
+#include <fstream>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+NORI_NAMESPACE_BEGIN
+
+#if defined(__linux__)
+/**
+ * \brief Binds the threads that enter an arena to a set of CPUs
+ *
+ * Threads are bound when they join the arena and get back the affinity of
+ * the process when they leave it (TBB's workers move between arenas).
+ */
+class ThreadArena::AffinityObserver : public tbb::task_scheduler_observer {
+public:
+    AffinityObserver(tbb::task_arena &arena, const std::vector<int> &cpus, bool pin)
+        : tbb::task_scheduler_observer(arena), m_cpus(cpus), m_pin(pin) {
+        sched_getaffinity(0, sizeof(cpu_set_t), &m_processMask);
+        observe(true);
+    }
+
+    ~AffinityObserver() {
+        observe(false);
+    }
+
+    void on_scheduler_entry(bool isWorker) {
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        if (m_pin) {
+            /* Workers leave and re-enter the arena for every parallel
+               loop, so the CPU depends on the (fixed) slot of the thread */
+            int slot = std::max(0, tbb::task_arena::current_thread_index());
+            CPU_SET(m_cpus[slot % m_cpus.size()], &mask);
+        } else {
+            for (int cpu : m_cpus)
+                CPU_SET(cpu, &mask);
+        }
+        sched_setaffinity(0, sizeof(cpu_set_t), &mask);
+    }
+
+    void on_scheduler_exit(bool isWorker) {
+        sched_setaffinity(0, sizeof(cpu_set_t), &m_processMask);
+    }
+
+private:
+    std::vector<int> m_cpus;
+    bool m_pin;
+    cpu_set_t m_processMask;
+};
+
+/// Return the CPUs that the process may run on
+static std::vector<int> processCPUs() {
+    cpu_set_t mask;
+    std::vector<int> cpus;
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &mask) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            if (CPU_ISSET(cpu, &mask))
+                cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+std::vector<int> ThreadArena::getNodeCPUs(int node) {
+    /* The kernel lists the CPUs of a node as ranges, e.g. "0-7,16-23" */
+    std::string filename = tfm::format("/sys/devices/system/node/node%i/cpulist", node);
+    std::ifstream is(filename);
+    std::string list;
+    if (node < 0 || !std::getline(is, list))
+        throw NoriException("ThreadArena: NUMA node %i does not exist!", node);
+
+    std::vector<int> allowed = processCPUs(), cpus;
+    for (const std::string &range : tokenize(list, ",")) {
+        std::vector<std::string> bounds = tokenize(range, "-");
+        if (bounds.empty())
+            continue;
+        int first = toInt(bounds[0]), last = toInt(bounds.back());
+        for (int cpu = first; cpu <= last; ++cpu)
+            if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end())
+                cpus.push_back(cpu);
+    }
+
+    if (cpus.empty())
+        throw NoriException("ThreadArena: the process may not run on the CPUs of NUMA node %i!", node);
+    return cpus;
+}
+#else
+class ThreadArena::AffinityObserver { };
+
+std::vector<int> ThreadArena::getNodeCPUs(int node) {
+    throw NoriException("ThreadArena: NUMA nodes are only supported on Linux!");
+}
+#endif
+
+ThreadArena::ThreadArena(int threads, int numaNode, bool pinThreads)
+    : m_threads(threads), m_numaNode(numaNode), m_pinThreads(pinThreads) {
+#if defined(__linux__)
+    std::vector<int> cpus;
+    if (numaNode >= 0)
+        cpus = getNodeCPUs(numaNode);
+    else if (pinThreads)
+        cpus = processCPUs();
+
+    if (m_threads <= 0)
+        m_threads = numaNode >= 0 ? (int) cpus.size()
+                                  : tbb::task_scheduler_init::default_num_threads();
+
+    m_arena.reset(new tbb::task_arena(m_threads));
+    if (!cpus.empty())
+        m_observer.reset(new AffinityObserver(*m_arena, cpus, pinThreads));
+#else
+    if (numaNode >= 0 || pinThreads) {
+        cerr << "Warning: ThreadArena: thread affinity is only supported on Linux" << endl;
+        m_numaNode = -1;
+        m_pinThreads = false;
+    }
+    if (m_threads <= 0)
+        m_threads = tbb::task_scheduler_init::default_num_threads();
+    m_arena.reset(new tbb::task_arena(m_threads));
+#endif
+}
+
+ThreadArena::~ThreadArena() {
+    /* Stop observing before the arena goes away */
+    m_observer.reset();
+    m_arena.reset();
+}
+
+std::string ThreadArena::toString() const {
+    return tfm::format("ThreadArena[threads=%i, numaNode=%s, pinThreads=%s]", m_threads,
+                       m_numaNode >= 0 ? std::to_string(m_numaNode) : std::string("any"),
+                       m_pinThreads ? "true" : "false");
+}
+
+NORI_NAMESPACE_END
@@ -41,24 +41,28 @@ Bitmap::Bitmap(const std::string &filename) {
     cout << "Reading a " << cols() << "x" << rows() << " OpenEXR file from \""
          << filename << "\"" << endl;
 
+    /* Prefer the channels of the default layer over those of other
+       layers (e.g. the AOVs written by save()) */
     const char *ch_r = nullptr, *ch_g = nullptr, *ch_b = nullptr;
-    for (Imf::ChannelList::ConstIterator it = channels.begin(); it != channels.end(); ++it) {
-        std::string name = toLower(it.name());
-
-        if (it.channel().xSampling != 1 || it.channel().ySampling != 1) {
-            /* Sub-sampled layers are not supported */
-            continue;
-        }
-
-        if (!ch_r && (name == "r" || name == "red" || 
-                endsWith(name, ".r") || endsWith(name, ".red"))) {
-            ch_r = it.name();
-        } else if (!ch_g && (name == "g" || name == "green" || 
-                endsWith(name, ".g") || endsWith(name, ".green"))) {
-            ch_g = it.name();
-        } else if (!ch_b && (name == "b" || name == "blue" || 
-                endsWith(name, ".b") || endsWith(name, ".blue"))) {
-            ch_b = it.name();
+    for (int layered = 0; layered < 2; ++layered) {
+        for (Imf::ChannelList::ConstIterator it = channels.begin(); it != channels.end(); ++it) {
+            std::string name = toLower(it.name());
+
+            if (it.channel().xSampling != 1 || it.channel().ySampling != 1) {
+                /* Sub-sampled layers are not supported */
+                continue;
+            }
+
+            if (!ch_r && (layered ? (endsWith(name, ".r") || endsWith(name, ".red"))
+                                  : (name == "r" || name == "red"))) {
+                ch_r = it.name();
+            } else if (!ch_g && (layered ? (endsWith(name, ".g") || endsWith(name, ".green"))
+                                         : (name == "g" || name == "green"))) {
+                ch_g = it.name();
+            } else if (!ch_b && (layered ? (endsWith(name, ".b") || endsWith(name, ".blue"))
+                                         : (name == "b" || name == "blue"))) {
+                ch_b = it.name();
+            }
         }
     }
 
@@ -79,9 +83,14 @@ Bitmap::Bitmap(const std::string &filename) {
     file.readPixels(dw.min.y, dw.max.y);
 }
 
-void Bitmap::save(const std::string &filename) {
-    cout << "Writing a " << cols() << "x" << rows() 
-         << " OpenEXR file to \"" << filename << "\"" << endl;
+void Bitmap::save(const std::string &filename, const std::vector<Layer> &layers, bool verbose) {
+    if (verbose) {
+        cout << "Writing a " << cols() << "x" << rows() 
+             << " OpenEXR file to \"" << filename << "\"";
+        if (!layers.empty())
+            cout << " (with " << layers.size() << " additional layers)";
+        cout << endl;
+    }
 
     Imf::Header header((int) cols(), (int) rows());
     header.insert("comments", Imf::StringAttribute("Generated by Nori"));
@@ -101,6 +110,21 @@ void Bitmap::save(const std::string &filename) {
     frameBuffer.insert("G", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
     frameBuffer.insert("B", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); 
 
+    /* Channels of the additional layers, e.g. "albedo.R" */
+    for (const Layer &layer : layers) {
+        if (layer.bitmap->cols() != cols() || layer.bitmap->rows() != rows())
+            throw NoriException("Bitmap::save(): the layer \"%s\" has a different size!", layer.name);
+        if (layer.channels.empty() || layer.channels.size() > 3)
+            throw NoriException("Bitmap::save(): invalid channels of the layer \"%s\"!", layer.name);
+        char *layerPtr = reinterpret_cast<char *>(const_cast<Color3f *>(layer.bitmap->data()));
+        for (size_t i = 0; i < layer.channels.size(); ++i) {
+            std::string channel = layer.name + "." + layer.channels[i];
+            channels.insert(channel, Imf::Channel(Imf::FLOAT));
+            frameBuffer.insert(channel, Imf::Slice(Imf::FLOAT, layerPtr + i * compStride,
+                                                   pixelStride, rowStride));
+        }
+    }
+
     Imf::OutputFile file(filename.c_str(), header);
     file.setFrameBuffer(frameBuffer);
     file.writePixels((int) rows());
@@ -119,9 +143,10 @@ static float Clamp(float val, float low, float high) {
         return val;
 }
 
-void Bitmap::saveToLDR(const std::string &filename) {
-    cout << "Writing a " << cols() << "x" << rows()
-    << " PNG file to \"" << filename << "\"" << endl;
+void Bitmap::saveToLDR(const std::string &filename, bool verbose) {
+    if (verbose)
+        cout << "Writing a " << cols() << "x" << rows()
+        << " PNG file to \"" << filename << "\"" << endl;
 
     std::unique_ptr<uint8_t[]> rgb8(new uint8_t[3 * cols() * rows()]);
     uint8_t *dst = rgb8.get();
@@ -20,6 +20,7 @@
 #include <nori/bitmap.h>
 #include <nori/rfilter.h>
 #include <nori/bbox.h>
+#include <nori/qmc.h>
 #include <tbb/tbb.h>
 
 NORI_NAMESPACE_BEGIN
@@ -41,6 +42,8 @@ void ImageBlock::init(const Vector2i &size, const ReconstructionFilter *filter)
     m_borderSize = 0;
     m_filterRadius = 0;
     m_lookupFactor = 0;
+    m_footprint = 0;
+    m_invalidSamples = 0;
     m_blockId = 0;
 
     if(m_filter) {
@@ -62,6 +65,7 @@ void ImageBlock::init(const Vector2i &size, const ReconstructionFilter *filter)
         }
         m_filter[NORI_FILTER_RESOLUTION] = 0.0f;
         m_lookupFactor = NORI_FILTER_RESOLUTION / m_filterRadius;
+        m_footprint = (int) std::ceil(2*m_filterRadius);
         int weightSize = (int) std::ceil(2*m_filterRadius) + 1;
         m_weightsX = new float[weightSize];
         m_weightsY = new float[weightSize];
@@ -71,6 +75,16 @@ void ImageBlock::init(const Vector2i &size, const ReconstructionFilter *filter)
 
     /* Allocate space for pixels and border regions */
     resize(size.y() + 2*m_borderSize, size.x() + 2*m_borderSize);
+    for (Plane &plane : m_aovs)
+        plane.resize(rows(), cols());
+}
+
+void ImageBlock::setAOVCount(int count) {
+    m_aovs.resize(count);
+    for (Plane &plane : m_aovs) {
+        plane.resize(rows(), cols());
+        plane.setConstant(Color4f());
+    }
 }
 
 Bitmap *ImageBlock::toBitmap() const {
@@ -81,6 +95,33 @@ Bitmap *ImageBlock::toBitmap() const {
     return result;
 }
 
+/// Normalize a rectangular region of a plane (see \ref ImageBlock::toBitmap())
+static Bitmap *planeToBitmap(const ImageBlock::Plane &plane, const Point2i &blockOffset,
+                             const Vector2i &blockSize, int border, const Point2i &offset,
+                             const Vector2i &size, bool crop) {
+    Point2i origin = offset - blockOffset;
+    if ((origin.array() < 0).any() || ((origin + size).array() > blockSize.array()).any())
+        throw NoriException("ImageBlock::toBitmap(): the region exceeds the block!");
+
+    Bitmap *result = new Bitmap(crop ? size : blockSize);
+    Point2i target = crop ? Point2i(0, 0) : origin;
+    if (!crop)
+        result->setConstant(Color3f(0.0f));
+    for (int y=0; y<size.y(); ++y)
+        for (int x=0; x<size.x(); ++x)
+            result->coeffRef(target.y() + y, target.x() + x) =
+                plane.coeff(origin.y() + y + border, origin.x() + x + border).divideByFilterWeight();
+    return result;
+}
+
+Bitmap *ImageBlock::toBitmap(const Point2i &offset, const Vector2i &size, bool crop) const {
+    return planeToBitmap(*this, m_offset, m_size, m_borderSize, offset, size, crop);
+}
+
+Bitmap *ImageBlock::aovToBitmap(int index, const Point2i &offset, const Vector2i &size, bool crop) const {
+    return planeToBitmap(m_aovs[index], m_offset, m_size, m_borderSize, offset, size, crop);
+}
+
 void ImageBlock::fromBitmap(const Bitmap &bitmap) {
     if (bitmap.cols() != cols() || bitmap.rows() != rows())
         throw NoriException("Invalid bitmap dimensions!");
@@ -90,10 +131,54 @@ void ImageBlock::fromBitmap(const Bitmap &bitmap) {
             coeffRef(y, x) << bitmap.coeff(y, x), 1;
 }
 
-void ImageBlock::put(const Point2f &_pos, const Color3f &value) {
-    if (!value.isValid()) {
-        /* If this happens, go fix your code instead of removing this warning ;) */
-        cerr << "Integrator: computed an invalid radiance value: " << value.toString() << endl;
+/// Add a weighted row of samples to \c N consecutive pixels
+template <int N> static inline void splatRows(ImageBlock::Plane &plane, int x0, int y0,
+                                              const Color4f *valueX, const float *weightsY) {
+    for (int y = 0; y < N; ++y) {
+        Color4f *row = &plane.coeffRef(y0 + y, x0);
+        for (int x = 0; x < N; ++x)
+            row[x] += valueX[x] * weightsY[y];
+    }
+}
+
+template <int N> bool ImageBlock::splat(const Point2f &pos, const Color3f &value, const Color3f *aovs) {
+    /* All pixels with a nonzero weight lie within N pixels of the
+       first one that the filter support touches */
+    int x0 = (int) std::ceil(pos.x() - m_filterRadius), y0 = (int) std::ceil(pos.y() - m_filterRadius);
+    if (x0 < 0 || y0 < 0 || x0 + N > cols() || y0 + N > rows())
+        return false;
+    int x1 = (int) std::floor(pos.x() + m_filterRadius), y1 = (int) std::floor(pos.y() + m_filterRadius);
+
+    /* Same lookups as the general path (pixels past the support get zero) */
+    float weightsX[N], weightsY[N];
+    for (int i = 0; i < N; ++i) {
+        weightsX[i] = x0 + i <= x1 ? m_filter[(int) (std::abs(x0 + i - pos.x()) * m_lookupFactor)] : 0.0f;
+        weightsY[i] = y0 + i <= y1 ? m_filter[(int) (std::abs(y0 + i - pos.y()) * m_lookupFactor)] : 0.0f;
+    }
+
+    /* Every pixel is a single 4-wide multiply-add on Color4f. The weights
+       are applied in the same order as in the general path, so both give
+       bit-identical results */
+    Color4f valueX[N];
+    for (int i = 0; i < N; ++i)
+        valueX[i] = Color4f(value) * weightsX[i];
+    splatRows<N>(*this, x0, y0, valueX, weightsY);
+
+    if (aovs) {
+        for (size_t j = 0; j < m_aovs.size(); ++j) {
+            for (int i = 0; i < N; ++i)
+                valueX[i] = Color4f(aovs[j]) * weightsX[i];
+            splatRows<N>(m_aovs[j], x0, y0, valueX, weightsY);
+        }
+    }
+    return true;
+}
+
+void ImageBlock::put(const Point2f &_pos, const Color3f &value, const Color3f *aovs) {
+    if (m_sampleCheck &&
+        !((value >= 0.0f) && (value < std::numeric_limits<float>::infinity())).all()) {
+        /* The renderer reports these once per frame (go fix your integrator ;) */
+        ++m_invalidSamples;
         return;
     }
 
@@ -103,6 +188,15 @@ void ImageBlock::put(const Point2f &_pos, const Color3f &value) {
         _pos.y() - 0.5f - (m_offset.y() - m_borderSize)
     );
 
+    /* Fast paths for the box (1x1), tent (2x2) and radius-2 (4x4) filters */
+    switch (m_footprint) {
+        case 1: if (splat<1>(pos, value, aovs)) return; break;
+        case 2: if (splat<2>(pos, value, aovs)) return; break;
+        case 3:
+        case 4: if (splat<4>(pos, value, aovs)) return; break;
+        default: break;
+    }
+
     /* Compute the rectangle of pixels that will need to be updated */
     BoundingBox2i bbox(
         Point2i((int)  std::ceil(pos.x() - m_filterRadius), (int)  std::ceil(pos.y() - m_filterRadius)),
@@ -119,17 +213,32 @@ void ImageBlock::put(const Point2f &_pos, const Color3f &value) {
     for (int y=bbox.min.y(), yr=0; y<=bbox.max.y(); ++y, ++yr) 
         for (int x=bbox.min.x(), xr=0; x<=bbox.max.x(); ++x, ++xr) 
             coeffRef(y, x) += Color4f(value) * m_weightsX[xr] * m_weightsY[yr];
+
+    if (!aovs)
+        return;
+    for (size_t i = 0; i < m_aovs.size(); ++i) {
+        Plane &plane = m_aovs[i];
+        for (int y=bbox.min.y(), yr=0; y<=bbox.max.y(); ++y, ++yr)
+            for (int x=bbox.min.x(), xr=0; x<=bbox.max.x(); ++x, ++xr)
+                plane.coeffRef(y, x) += Color4f(aovs[i]) * m_weightsX[xr] * m_weightsY[yr];
+    }
 }
-    
+
 void ImageBlock::put(ImageBlock &b) {
+    tbb::mutex::scoped_lock lock(m_mutex);
+    accumulate(b);
+}
+
+void ImageBlock::accumulate(const ImageBlock &b) {
     Vector2i offset = b.getOffset() - m_offset +
         Vector2i::Constant(m_borderSize - b.getBorderSize());
     Vector2i size   = b.getSize()   + Vector2i(2*b.getBorderSize());
 
-    tbb::mutex::scoped_lock lock(m_mutex);
-
     block(offset.y(), offset.x(), size.y(), size.x()) 
         += b.topLeftCorner(size.y(), size.x());
+    for (size_t i = 0; i < m_aovs.size() && i < b.m_aovs.size(); ++i)
+        m_aovs[i].block(offset.y(), offset.x(), size.y(), size.x())
+            += b.m_aovs[i].topLeftCorner(size.y(), size.x());
 }
 
 std::string ImageBlock::toString() const {
@@ -137,54 +246,126 @@ std::string ImageBlock::toString() const {
         m_offset.toString(), m_size.toString());
 }
 
-BlockGenerator::BlockGenerator(const Vector2i &size, int blockSize)
-        : m_size(size), m_blockSize(blockSize) {
+BlockGenerator::BlockGenerator(const Vector2i &size, int blockSize, EOrder order)
+        : BlockGenerator(Point2i(0, 0), size, blockSize, order) { }
+
+/// Position of the grid cell (x, y) along a Hilbert curve that covers an n x n grid
+static uint64_t hilbertIndex(uint32_t n, uint32_t x, uint32_t y) {
+    uint64_t d = 0;
+    for (uint32_t s = n / 2; s > 0; s /= 2) {
+        uint32_t rx = (x & s) > 0, ry = (y & s) > 0;
+        d += (uint64_t) s * s * ((3 * rx) ^ ry);
+        /* Rotate the quadrant */
+        if (ry == 0) {
+            if (rx == 1) {
+                x = n - 1 - x;
+                y = n - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+BlockGenerator::BlockGenerator(const Point2i &offset, const Vector2i &size, int blockSize,
+                               EOrder order)
+        : m_offset(offset), m_size(size), m_blockSize(blockSize), m_next(0) {
     m_numBlocks = Vector2i(
         (int) std::ceil(size.x() / (float) blockSize),
         (int) std::ceil(size.y() / (float) blockSize));
-    reset();
+    int numBlocks = m_numBlocks.x() * m_numBlocks.y();
+    m_order.reserve(numBlocks);
+
+    if (order == ESpiral) {
+        enum EDirection { ERight = 0, EDown, ELeft, EUp };
+        Point2i block(m_numBlocks / 2);
+        int direction = ERight, numSteps = 1, stepsLeft = 1;
+        while (true) {
+            m_order.push_back(block);
+            if ((int) m_order.size() == numBlocks)
+                break;
+            do {
+                switch (direction) {
+                    case ERight: ++block.x(); break;
+                    case EDown:  ++block.y(); break;
+                    case ELeft:  --block.x(); break;
+                    case EUp:    --block.y(); break;
+                }
+
+                if (--stepsLeft == 0) {
+                    direction = (direction + 1) % 4;
+                    if (direction == ELeft || direction == ERight) 
+                        ++numSteps;
+                    stepsLeft = numSteps;
+                }
+            } while ((block.array() < 0).any() ||
+                     (block.array() >= m_numBlocks.array()).any());
+        }
+    } else {
+        /* Sort the blocks by their position along a curve that covers a
+           power-of-two grid large enough for the image */
+        uint32_t n = 1;
+        while (n < (uint32_t) m_numBlocks.maxCoeff())
+            n *= 2;
+        std::vector<std::pair<uint64_t, Point2i>> keys;
+        keys.reserve(numBlocks);
+        for (int y = 0; y < m_numBlocks.y(); ++y) {
+            for (int x = 0; x < m_numBlocks.x(); ++x) {
+                uint64_t key = order == EHilbert ? hilbertIndex(n, (uint32_t) x, (uint32_t) y)
+                                                 : QMC::encodeMorton2((uint32_t) x, (uint32_t) y);
+                keys.push_back(std::make_pair(key, Point2i(x, y)));
+            }
+        }
+        std::sort(keys.begin(), keys.end(),
+            [](const std::pair<uint64_t, Point2i> &a, const std::pair<uint64_t, Point2i> &b) {
+                return a.first < b.first;
+            });
+        for (auto &key : keys)
+            m_order.push_back(key.second);
+    }
 }
 
 void BlockGenerator::reset() {
-    m_blocksLeft = m_numBlocks.x() * m_numBlocks.y();
-    m_direction = ERight;
-    m_block = Point2i(m_numBlocks / 2);
-    m_stepsLeft = 1;
-    m_numSteps = 1;
+    m_next = 0;
 }
 
 bool BlockGenerator::next(ImageBlock &block) {
-    tbb::mutex::scoped_lock lock(m_mutex);
-
-    if (m_blocksLeft == 0)
+    int index = m_next++;
+    if (index >= (int) m_order.size())
         return false;
 
-    Point2i pos = m_block * m_blockSize;
-    block.setOffset(pos);
+    const Point2i &grid = m_order[index];
+    Point2i pos = grid * m_blockSize;
+    block.setOffset(m_offset + pos);
     block.setSize((m_size - pos).cwiseMin(Vector2i::Constant(m_blockSize)));
-    block.setBlockId(m_block.y() * m_numBlocks.x() + m_block.x());
-
-    if (--m_blocksLeft == 0)
-        return true;
-
-    do {
-        switch (m_direction) {
-            case ERight: ++m_block.x(); break;
-            case EDown:  ++m_block.y(); break;
-            case ELeft:  --m_block.x(); break;
-            case EUp:    --m_block.y(); break;
-        }
+    block.setBlockId(grid.y() * m_numBlocks.x() + grid.x());
+    return true;
+}
 
-        if (--m_stepsLeft == 0) {
-            m_direction = (m_direction + 1) % 4;
-            if (m_direction == ELeft || m_direction == ERight) 
-                ++m_numSteps;
-            m_stepsLeft = m_numSteps;
-        }
-    } while ((m_block.array() < 0).any() ||
-             (m_block.array() >= m_numBlocks.array()).any());
+BlockGenerator::EOrder BlockGenerator::orderFromString(const std::string &name) {
+    if (name == "spiral")
+        return ESpiral;
+    else if (name == "hilbert")
+        return EHilbert;
+    else if (name == "morton")
+        return EMorton;
+    throw NoriException("BlockGenerator: unknown block order \"%s\"!", name);
+}
 
-    return true;
+int BlockGenerator::optimalBlockSize(const Vector2i &size, int threads, int borderSize) {
+    /* Blocks per thread that keep the load balanced until the end of a pass */
+    const int blocksPerThread = 4;
+    const int minBlockSize = 8;
+
+    int blockSize = NORI_BLOCK_SIZE;
+    while (blockSize / 2 >= minBlockSize && blockSize / 2 > 2 * borderSize) {
+        int numBlocks = ((size.x() + blockSize - 1) / blockSize) *
+                        ((size.y() + blockSize - 1) / blockSize);
+        if (numBlocks >= blocksPerThread * threads)
+            break;
+        blockSize /= 2;
+    }
+    return blockSize;
 }
 
 NORI_NAMESPACE_END
@@ -0,0 +1,275 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob, Romain Prévost
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <nori/checkpoint.h>
+#include <nori/bitmap.h>
+#include <fstream>
+#include <cstdio>
+
+NORI_NAMESPACE_BEGIN
+
+/* File identifier, including a format version */
+static const char checkpointMagic[8] = { 'N', 'O', 'R', 'I', 'C', 'K', 'P', '5' };
+static const char partialMagic[8] = { 'N', 'O', 'R', 'I', 'P', 'R', 'T', '1' };
+
+template <typename T> static void write(std::ostream &os, const T &value) {
+    os.write((const char *) &value, sizeof(T));
+}
+
+template <typename T> static void read(std::istream &is, T &value) {
+    is.read((char *) &value, sizeof(T));
+}
+
+static void writeArray(std::ostream &os, const char *data, uint64_t size) {
+    write(os, size);
+    os.write(data, (std::streamsize) size);
+}
+
+static void writeArray(std::ostream &os, const std::vector<float> &v) {
+    write(os, (uint64_t) v.size());
+    os.write((const char *) v.data(), (std::streamsize) (v.size() * sizeof(float)));
+}
+
+/// Number of bytes between the read position and the end of a file
+static uint64_t remainingBytes(std::istream &is) {
+    std::streampos pos = is.tellg();
+    is.seekg(0, std::ios::end);
+    std::streampos end = is.tellg();
+    is.seekg(pos);
+    return is && end > pos ? (uint64_t) (end - pos) : 0;
+}
+
+/* The sizes of arrays are checked against the rest of the file before
+   allocating, so that a corrupt file fails the stream (and is reported
+   as truncated by the caller) instead of allocating huge buffers */
+static void readArray(std::istream &is, std::string &s) {
+    uint64_t size = 0;
+    read(is, size);
+    if (!is || size > remainingBytes(is)) {
+        is.setstate(std::ios::failbit);
+        return;
+    }
+    s.resize((size_t) size);
+    is.read(&s[0], (std::streamsize) size);
+}
+
+static void readArray(std::istream &is, std::vector<float> &v) {
+    uint64_t size = 0;
+    read(is, size);
+    if (!is || size > remainingBytes(is) / sizeof(float)) {
+        is.setstate(std::ios::failbit);
+        return;
+    }
+    v.resize((size_t) size);
+    is.read((char *) v.data(), (std::streamsize) (size * sizeof(float)));
+}
+
+void RenderCheckpoint::save(const std::string &filename) const {
+    std::string tempName = filename + ".tmp";
+    {
+        std::ofstream os(tempName, std::ios::binary);
+        if (!os)
+            throw NoriException("Unable to create the checkpoint \"%s\"!", tempName);
+
+        os.write(checkpointMagic, sizeof(checkpointMagic));
+        write(os, outputSize.x()); write(os, outputSize.y());
+        write(os, cropOffset.x()); write(os, cropOffset.y());
+        write(os, cropSize.x()); write(os, cropSize.y());
+        write(os, blockSize);
+        write(os, blockOrder);
+        write(os, borderSize);
+        write(os, sampleCount);
+        write(os, (uint8_t) adaptive);
+        write(os, sampleOffset);
+        write(os, seedOffset);
+        write(os, workerIndex);
+        write(os, workerCount);
+
+        write(os, frame);
+        write(os, samples);
+        write(os, pass);
+        write(os, passSamples);
+        write(os, spent);
+        write(os, elapsed);
+
+        write(os, (uint64_t) tiles.size());
+        for (const Tile &tile : tiles) {
+            write(os, tile.samples);
+            write(os, (uint8_t) tile.active);
+            writeArray(os, tile.sampler.data(), tile.sampler.size());
+            writeArray(os, tile.data);
+            writeArray(os, tile.halfData);
+        }
+
+        if (!os)
+            throw NoriException("Unable to write the checkpoint \"%s\"!", tempName);
+    }
+
+    if (std::rename(tempName.c_str(), filename.c_str()) != 0)
+        throw NoriException("Unable to replace the checkpoint \"%s\"!", filename);
+}
+
+void RenderCheckpoint::load(const std::string &filename) {
+    std::ifstream is(filename, std::ios::binary);
+    if (!is)
+        throw NoriException("Unable to open the checkpoint \"%s\"!", filename);
+
+    char magic[sizeof(checkpointMagic)];
+    is.read(magic, sizeof(magic));
+    if (!is || !std::equal(magic, magic + sizeof(magic), checkpointMagic))
+        throw NoriException("\"%s\" is not a Nori checkpoint!", filename);
+
+    uint8_t flag = 0;
+    read(is, outputSize.x()); read(is, outputSize.y());
+    read(is, cropOffset.x()); read(is, cropOffset.y());
+    read(is, cropSize.x()); read(is, cropSize.y());
+    read(is, blockSize);
+    read(is, blockOrder);
+    read(is, borderSize);
+    read(is, sampleCount);
+    read(is, flag);
+    adaptive = flag != 0;
+    read(is, sampleOffset);
+    read(is, seedOffset);
+    read(is, workerIndex);
+    read(is, workerCount);
+
+    read(is, frame);
+    read(is, samples);
+    read(is, pass);
+    read(is, passSamples);
+    read(is, spent);
+    read(is, elapsed);
+
+    uint64_t tileCount = 0;
+    read(is, tileCount);
+    if (!is)
+        throw NoriException("The checkpoint \"%s\" is truncated!", filename);
+
+    /* The tiles must match the block grid of the rendered region */
+    if (blockSize <= 0 || (cropSize.array() <= 0).any() ||
+        tileCount != (uint64_t) (((int64_t) cropSize.x() + blockSize - 1) / blockSize) *
+                     (uint64_t) (((int64_t) cropSize.y() + blockSize - 1) / blockSize))
+        throw NoriException("The checkpoint \"%s\" is corrupt!", filename);
+    tiles.resize((size_t) tileCount);
+    for (Tile &tile : tiles) {
+        read(is, tile.samples);
+        read(is, flag);
+        tile.active = flag != 0;
+        readArray(is, tile.sampler);
+        readArray(is, tile.data);
+        readArray(is, tile.halfData);
+        if (!is)
+            throw NoriException("The checkpoint \"%s\" is truncated!", filename);
+    }
+}
+
+bool RenderCheckpoint::isCompatible(const RenderCheckpoint &other) const {
+    return outputSize == other.outputSize &&
+        cropOffset == other.cropOffset &&
+        cropSize == other.cropSize &&
+        blockSize == other.blockSize &&
+        blockOrder == other.blockOrder &&
+        borderSize == other.borderSize &&
+        sampleCount == other.sampleCount &&
+        adaptive == other.adaptive &&
+        sampleOffset == other.sampleOffset &&
+        seedOffset == other.seedOffset &&
+        workerIndex == other.workerIndex &&
+        workerCount == other.workerCount;
+}
+
+void RenderPartial::save(const std::string &filename) const {
+    std::string tempName = filename + ".tmp";
+    {
+        std::ofstream os(tempName, std::ios::binary);
+        if (!os)
+            throw NoriException("Unable to create the partial rendering \"%s\"!", tempName);
+
+        os.write(partialMagic, sizeof(partialMagic));
+        write(os, outputSize.x()); write(os, outputSize.y());
+        write(os, borderSize);
+        write(os, sampleOffset);
+        write(os, sampleCount);
+        write(os, seedOffset);
+        write(os, workerIndex);
+        write(os, workerCount);
+        writeArray(os, data);
+
+        if (!os)
+            throw NoriException("Unable to write the partial rendering \"%s\"!", tempName);
+    }
+
+    if (std::rename(tempName.c_str(), filename.c_str()) != 0)
+        throw NoriException("Unable to replace the partial rendering \"%s\"!", filename);
+}
+
+void RenderPartial::load(const std::string &filename) {
+    std::ifstream is(filename, std::ios::binary);
+    if (!is)
+        throw NoriException("Unable to open the partial rendering \"%s\"!", filename);
+
+    char magic[sizeof(partialMagic)];
+    is.read(magic, sizeof(magic));
+    if (!is || !std::equal(magic, magic + sizeof(magic), partialMagic))
+        throw NoriException("\"%s\" is not a partial Nori rendering!", filename);
+
+    read(is, outputSize.x()); read(is, outputSize.y());
+    read(is, borderSize);
+    read(is, sampleOffset);
+    read(is, sampleCount);
+    read(is, seedOffset);
+    read(is, workerIndex);
+    read(is, workerCount);
+    if (!is || (outputSize.array() <= 0).any() || borderSize < 0)
+        throw NoriException("The partial rendering \"%s\" is corrupt!", filename);
+
+    /* Check the size of the pixels against the header before reading them */
+    uint64_t expected = ((uint64_t) outputSize.x() + 2 * (uint64_t) borderSize) *
+                        ((uint64_t) outputSize.y() + 2 * (uint64_t) borderSize) * 4;
+    uint64_t size = 0;
+    read(is, size);
+    if (!is || size != expected || size > remainingBytes(is) / sizeof(float))
+        throw NoriException("The partial rendering \"%s\" is truncated!", filename);
+    data.resize((size_t) size);
+    is.read((char *) data.data(), (std::streamsize) (size * sizeof(float)));
+    if (!is)
+        throw NoriException("The partial rendering \"%s\" is truncated!", filename);
+}
+
+void RenderPartial::accumulate(const RenderPartial &other) {
+    if (outputSize != other.outputSize || borderSize != other.borderSize)
+        throw NoriException("Cannot merge partial renderings of different images (%s vs %s)!",
+                            outputSize.toString(), other.outputSize.toString());
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] += other.data[i];
+}
+
+Bitmap *RenderPartial::toBitmap() const {
+    Bitmap *result = new Bitmap(outputSize);
+    int width = outputSize.x() + 2 * borderSize;
+    for (int y = 0; y < outputSize.y(); ++y) {
+        for (int x = 0; x < outputSize.x(); ++x) {
+            const float *p = &data[((size_t) (y + borderSize) * width + x + borderSize) * 4];
+            result->coeffRef(y, x) = Color4f(p[0], p[1], p[2], p[3]).divideByFilterWeight();
+        }
+    }
+    return result;
+}
+
+NORI_NAMESPACE_END
@@ -56,11 +56,17 @@ public:
             return Color3f(0.0f);
         }
         bRec.measure = EDiscrete;
+        bRec.sampledLobe = EDeltaReflection;
+        bRec.pdf = 0.0f;
         bRec.wo = Vector3f(-bRec.wi.x(), -bRec.wi.y(), bRec.wi.z());
         bRec.eta = 1.0f;
         return fresnelCond(cosTheta,m_eta,m_k);
     }
 
+    virtual uint32_t getFlags() const override {
+        return EDeltaReflection;
+    }
+
     virtual std::string toString() const override {
         return tfm::format(
             "Conductor[\n"
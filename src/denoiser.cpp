@@ -0,0 +1,183 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <nori/denoiser.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+NORI_NAMESPACE_BEGIN
+
+/// Albedos below this value are not divided out (e.g. black or emitting surfaces)
+#define NORI_DENOISER_MIN_ALBEDO 0.01f
+
+Denoiser::Denoiser(int iterations, float sigmaLuminance, float sigmaNormal, float sigmaDepth)
+    : m_iterations(iterations), m_sigmaLuminance(sigmaLuminance),
+      m_sigmaNormal(sigmaNormal), m_sigmaDepth(sigmaDepth) {
+    if (iterations < 1)
+        throw NoriException("Denoiser: at least one iteration is required!");
+}
+
+/// Visit all rows of an image in parallel
+template <typename Func> static void forEachRow(int height, const Func &func) {
+    tbb::parallel_for(tbb::blocked_range<int>(0, height),
+        [&](const tbb::blocked_range<int> &range) {
+            for (int y = range.begin(); y != range.end(); ++y)
+                func(y);
+        });
+}
+
+Bitmap *Denoiser::denoise(const Bitmap &color, const Bitmap &variance, const Bitmap &albedo,
+                          const Bitmap &normal, const Bitmap &depth) const {
+    int width = (int) color.cols(), height = (int) color.rows();
+    for (const Bitmap *feature : { &variance, &albedo, &normal, &depth }) {
+        if (feature->cols() != width || feature->rows() != height)
+            throw NoriException("Denoiser: the feature buffers must have the size of the image!");
+    }
+    size_t size = (size_t) width * height;
+
+    /* Per-pixel state in flat arrays: the illumination (the image divided
+       by the albedo), the variance of its luminance, and the features */
+    std::vector<Color3f> illumination(size), nextIllumination(size), modulation(size);
+    std::vector<float> lumVariance(size), nextLumVariance(size), blurredVariance(size);
+    std::vector<Vector3f> normals(size);
+    std::vector<float> depths(size);
+    std::vector<uint8_t> valid(size);
+
+    forEachRow(height, [&](int y) {
+        for (int x = 0; x < width; ++x) {
+            size_t p = (size_t) y * width + x;
+            Color3f a = albedo.coeff(y, x);
+            for (int c = 0; c < 3; ++c)
+                modulation[p][c] = a[c] > NORI_DENOISER_MIN_ALBEDO ? a[c] : 1.0f;
+            illumination[p] = color.coeff(y, x) / modulation[p];
+
+            /* Standard deviation of the luminance (assuming that the
+               color channels are fully correlated) */
+            Color3f sigma = (variance.coeff(y, x).cwiseMax(0.0f)).sqrt() / modulation[p];
+            float lumSigma = sigma.getLuminance();
+            lumVariance[p] = lumSigma * lumSigma;
+
+            Color3f n = normal.coeff(y, x);
+            Vector3f nv(n.r(), n.g(), n.b());
+            valid[p] = nv.squaredNorm() > 1e-4f;
+            normals[p] = valid[p] ? nv.normalized() : Vector3f(0.0f);
+            depths[p] = depth.coeff(y, x).r();
+        }
+    });
+
+    static const float kernel[5] = { 1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16 };
+
+    for (int iteration = 0; iteration < m_iterations; ++iteration) {
+        int step = 1 << iteration;
+
+        /* The luminance weight uses a slightly blurred variance, which is
+           more robust than the estimate of a single pixel */
+        forEachRow(height, [&](int y) {
+            for (int x = 0; x < width; ++x) {
+                float sum = 0.0f, weightSum = 0.0f;
+                for (int dy = -1; dy <= 1; ++dy) {
+                    int qy = y + dy;
+                    if (qy < 0 || qy >= height)
+                        continue;
+                    for (int dx = -1; dx <= 1; ++dx) {
+                        int qx = x + dx;
+                        if (qx < 0 || qx >= width)
+                            continue;
+                        float weight = (dx == 0 ? 0.5f : 0.25f) * (dy == 0 ? 0.5f : 0.25f);
+                        sum += weight * lumVariance[(size_t) qy * width + qx];
+                        weightSum += weight;
+                    }
+                }
+                blurredVariance[(size_t) y * width + x] = sum / weightSum;
+            }
+        });
+
+        forEachRow(height, [&](int y) {
+            for (int x = 0; x < width; ++x) {
+                size_t p = (size_t) y * width + x;
+                float lumP = illumination[p].getLuminance();
+
+                Color3f sum(0.0f);
+                float varianceSum = 0.0f, weightSum = 0.0f;
+                for (int dy = -2; dy <= 2; ++dy) {
+                    int qy = y + dy * step;
+                    if (qy < 0 || qy >= height)
+                        continue;
+                    for (int dx = -2; dx <= 2; ++dx) {
+                        int qx = x + dx * step;
+                        if (qx < 0 || qx >= width)
+                            continue;
+                        size_t q = (size_t) qy * width + qx;
+
+                        float weight = kernel[dx + 2] * kernel[dy + 2];
+                        if (q != p) {
+                            /* Pixels with and without a surface are never combined */
+                            if (valid[p] != valid[q])
+                                continue;
+                            /* The smaller of the two deviations keeps the weights
+                               symmetric, which preserves the image brightness */
+                            float sigma = std::sqrt(std::min(blurredVariance[p], blurredVariance[q]));
+                            float exponent = std::abs(lumP - illumination[q].getLuminance()) /
+                                (m_sigmaLuminance * sigma + Epsilon);
+                            if (valid[p]) {
+                                float distance = (float) (step * std::max(std::abs(dx), std::abs(dy)));
+                                exponent += std::abs(depths[p] - depths[q]) /
+                                    (m_sigmaDepth * depths[p] * distance + Epsilon);
+                                weight *= std::pow(std::max(0.0f, normals[p].dot(normals[q])), m_sigmaNormal);
+                            }
+                            weight *= std::exp(-exponent);
+                        }
+
+                        sum += illumination[q] * weight;
+                        varianceSum += weight * weight * lumVariance[q];
+                        weightSum += weight;
+                    }
+                }
+
+                /* The pixel itself always has a positive weight */
+                nextIllumination[p] = sum / weightSum;
+                nextLumVariance[p] = varianceSum / (weightSum * weightSum);
+            }
+        });
+
+        illumination.swap(nextIllumination);
+        lumVariance.swap(nextLumVariance);
+    }
+
+    Bitmap *result = new Bitmap(Vector2i(width, height));
+    forEachRow(height, [&](int y) {
+        for (int x = 0; x < width; ++x) {
+            size_t p = (size_t) y * width + x;
+            result->coeffRef(y, x) = illumination[p] * modulation[p];
+        }
+    });
+    return result;
+}
+
+std::string Denoiser::toString() const {
+    return tfm::format(
+        "Denoiser[\n"
+        "  iterations = %i,\n"
+        "  sigmaLuminance = %f,\n"
+        "  sigmaNormal = %f,\n"
+        "  sigmaDepth = %f\n"
+        "]",
+        m_iterations, m_sigmaLuminance, m_sigmaNormal, m_sigmaDepth);
+}
+
+NORI_NAMESPACE_END
@@ -34,7 +34,6 @@ public:
         /* Width and height in pixels. Default: 720p */
         m_outputSize.x() = propList.getInteger("width", 1280);
         m_outputSize.y() = propList.getInteger("height", 720);
-        m_invOutputSize = m_outputSize.cast<float>().cwiseInverse();
 
         /* Specifies an optional camera-to-world transformation. Default: none */
         m_cameraToWorld = propList.getTransform("toWorld", Transform());
@@ -54,6 +53,7 @@ public:
     }
 
     virtual void activate() override {
+        m_invOutputSize = m_outputSize.cast<float>().cwiseInverse();
         float aspect = m_outputSize.x() / (float) m_outputSize.y();
 
         /* Project vectors in camera space onto a plane at z=1:
@@ -201,7 +201,6 @@ public:
 private:
     Vector2f m_invOutputSize;
     Transform m_sampleToCamera;
-    Transform m_cameraToWorld;
     float m_fov;
     float m_nearClip;
     float m_farClip;
@@ -0,0 +1,95 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <nori/sampler.h>
+#include <nori/block.h>
+#include <nori/qmc.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * Counter-based sampling - returns uniformly distributed random numbers
+ * on <tt>[0, 1)x[0, 1)</tt> that are a pure function of the pixel, the
+ * sample index, the dimension and a seed.
+ *
+ * Each value is obtained by hashing these four counters, so there is no
+ * state that carries over from one sample to the next. Tiles and sample
+ * ranges can therefore be rendered in any order, by any thread or
+ * process, and always receive the same random numbers. Different seeds
+ * give statistically independent images.
+ */
+class Deterministic final : public SamplerImpl<Deterministic> {
+public:
+    Deterministic(const PropertyList &propList) {
+        m_sampleCount = (size_t) propList.getInteger("sampleCount", 1);
+        m_seed = (uint32_t) propList.getInteger("seed", 0);
+    }
+
+    virtual ~Deterministic() { }
+
+    std::unique_ptr<Sampler> clone() const {
+        std::unique_ptr<Deterministic> cloned(new Deterministic());
+        cloned->m_sampleCount = m_sampleCount;
+        cloned->m_seedOffset = m_seedOffset;
+        cloned->m_seed = m_seed;
+        cloned->m_sampleKey = m_sampleKey;
+        cloned->m_dimension = m_dimension;
+        return cloned;
+    }
+
+    void prepare(const ImageBlock &block) {
+        startPixelSample(block.getOffset(), 0, 0);
+    }
+
+    void startPixelSample(const Point2i &pixel, uint32_t sampleIndex, uint32_t dimension) {
+        uint64_t pixelKey = QMC::mixBits(((uint64_t) (uint32_t) pixel.x() << 32) | (uint32_t) pixel.y());
+        m_sampleKey = QMC::mixBits(pixelKey ^ QMC::mixBits(((uint64_t) (m_seed + m_seedOffset) << 32) | sampleIndex));
+        m_dimension = dimension;
+    }
+
+    void generate() { /* No-op for this sampler */ }
+    void advance()  { /* No-op for this sampler */ }
+
+    float next1D() {
+        return QMC::toFloat(QMC::mixBits(m_sampleKey + ++m_dimension * 0x9E3779B97F4A7C15ull));
+    }
+
+    Point2f next2D() {
+        float x = next1D();
+        return Point2f(x, next1D());
+    }
+
+    /* The state is reset by every call to startPixelSample(), so
+       there is nothing to store in checkpoints */
+    void serialize(std::ostream &stream) const { }
+    void unserialize(std::istream &stream) { }
+
+    virtual std::string toString() const override {
+        return tfm::format("Deterministic[sampleCount=%i, seed=%i]", m_sampleCount, m_seed);
+    }
+protected:
+    Deterministic() { }
+
+private:
+    uint32_t m_seed = 0;
+    uint64_t m_sampleKey = 0;
+    uint64_t m_dimension = 0;
+};
+
+NORI_REGISTER_CLASS(Deterministic, "deterministic");
+NORI_NAMESPACE_END
@@ -46,15 +46,18 @@ public:
         
         float cosTheta = Frame::cosTheta(bRec.wi);
         bRec.measure = EDiscrete;
+        bRec.pdf = 0.0f;
         
         if (sample.x() < fresnelDiel(cosTheta, m_extIOR,m_intIOR)) {
             // Reflection
             bRec.wo = Vector3f(-bRec.wi.x(), -bRec.wi.y(), bRec.wi.z());
             bRec.eta = 1.0f;
+            bRec.sampledLobe = EDeltaReflection;
             
         }
         else {
             // Refraction
+            bRec.sampledLobe = EDeltaTransmission;
             float eta1_2 = m_extIOR / m_intIOR;
             Vector3f n = Vector3f(0.0f, 0.0f, 1.0f);
             if (cosTheta <= 0.0f) {
@@ -69,6 +72,10 @@ public:
         return Color3f(1.0f);
     }
 
+    virtual uint32_t getFlags() const override {
+        return EDeltaReflection | EDeltaTransmission | ETwoSided;
+    }
+
     virtual std::string toString() const override {
         return tfm::format(
             "Dielectric[\n"
@@ -105,10 +105,12 @@ public:
             return Color3f(0.0f);
 
         bRec.measure = ESolidAngle;
+        bRec.sampledLobe = EDiffuse;
 
         /* Warp a uniformly distributed sample on [0,1]^2
            to a direction on a cosine-weighted hemisphere */
         bRec.wo = Warp::squareToCosineHemisphere(sample);
+        bRec.pdf = INV_PI * Frame::cosTheta(bRec.wo);
 
         /* Relative index of refraction: no change */
         bRec.eta = 1.0f;
@@ -122,6 +124,14 @@ public:
         return true;
     }
 
+    virtual Color3f getAlbedo(const Point2f &uv) const override {
+        return m_albedo->eval(uv);
+    }
+
+    virtual uint32_t getFlags() const override {
+        return EDiffuse;
+    }
+
     /// Return a human-readable summary
     virtual std::string toString() const override {
         return tfm::format(
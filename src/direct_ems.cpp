@@ -20,15 +20,27 @@ public:
         if (!scene->rayIntersect(ray, its))
             return Color3f(0.0f);
         
-        // Random Light
-        const Emitter * emitter = scene->getRandomEmitter(sampler->next1D());
+        // Select a light (uniformly or by importance, see Scene::sampleEmitter())
+        float pdf_light;
+        const Emitter * emitter = scene->sampleEmitter(its.p, its.shFrame.n, sampler->next1D(), pdf_light);
+        
+        // Add the color from the emitter (first intersection)
+        Color3f Le = Color3f(0.f);
+        if (its.mesh->isEmitter()) {
+            EmitterQueryRecord lRecE(ray.o, its.p, its.shFrame.n);
+            Le = its.mesh->getEmitter()->eval(lRecE);
+        }
+        
+        // No light contributes to this point
+        if (!emitter)
+            return Le;
         
         // Query to get data from lights
         EmitterQueryRecord lRecR;
         lRecR.ref = its.p;
         
         // Call sample of emitter to fill query
-        Color3f radiance = emitter->sample(lRecR, sampler->next2D())*scene->getLights().size();
+        Color3f radiance = emitter->sample(lRecR, sampler->next2D()) / pdf_light;
         
         // Angle between direction from x to p and shading normal
         float cosTheta = Frame::cosTheta(its.shFrame.toLocal(lRecR.wi));
@@ -40,13 +52,6 @@ public:
         // Get the BSDF value
         Color3f BSDF = its.mesh->getBSDF()->eval(bRec);
         
-        // Add the color from the emitter (first intersection)
-        Color3f Le = Color3f(0.f);
-        if (its.mesh->isEmitter()) {
-            EmitterQueryRecord lRecE(ray.o, its.p, its.shFrame.n);
-            Le = its.mesh->getEmitter()->eval(lRecE);
-        }
-        
         // Check the shadowray
         float obstacle = 1.f;
         if (scene->rayIntersect(lRecR.shadowRay,its)) {
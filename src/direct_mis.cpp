@@ -28,35 +28,53 @@ public:
         
         /* Emitter Sampling */
         
-        // Random Light
-        const Emitter * emitter = scene->getRandomEmitter(sampler->next1D());
-        
-        // Query to get data from lights
-        EmitterQueryRecord lRecR_ems;
-        lRecR_ems.ref = itsE.p;
-        
-        // Call sample of emitter to fill query
-        Color3f radiance_ems = emitter->sample(lRecR_ems, sampler->next2D())*scene->getLights().size();
-        float pdf_emsE = emitter->pdf(lRecR_ems);
-        
-        // Angle between direction from x to p and shading normal
-        float cosTheta_ems = Frame::cosTheta(itsE.shFrame.toLocal(lRecR_ems.wi));
-        
-        // Query for the BSDF
-        BSDFQueryRecord bRec_ems = BSDFQueryRecord(itsE.shFrame.toLocal(-ray.d), itsE.shFrame.toLocal(lRecR_ems.wi), ESolidAngle);
-        
-        // Get the BSDF value
-        Color3f BSDF_ems = itsE.mesh->getBSDF()->eval(bRec_ems);
-        float pdf_emsB = itsE.mesh->getBSDF()->pdf(bRec_ems);
-        
-        // Set the uv coordinates of the query
-        bRec_ems.uv = itsE.uv;
-        
-        // Check the shadowray
-        float obstacle = 1.f;
-        Intersection its_ems;
-        if (scene->rayIntersect(lRecR_ems.shadowRay,its_ems)) {
-            obstacle = 0.f;
+        const BSDF * bsdf = itsE.mesh->getBSDF();
+        
+        // Select a light according to the scene's light sampler,
+        // unless the surface is purely specular and cannot be lit this way
+        float pdf_light = 0.f;
+        const Emitter * emitter = nullptr;
+        float sample_light = sampler->next1D();
+        Point2f samples[2];
+        sampler->next2DArray(samples, 2);
+        Point2f sample_ems = samples[0];
+        if (bsdf->hasSmoothComponent())
+            emitter = scene->sampleEmitter(itsE.p, itsE.shFrame.n, sample_light, pdf_light);
+        
+        Color3f L_ems(0.f);
+        if (emitter != nullptr) {
+            // Query to get data from lights
+            EmitterQueryRecord lRecR_ems;
+            lRecR_ems.ref = itsE.p;
+            
+            // Call sample of emitter to fill query
+            Color3f radiance_ems = emitter->sample(lRecR_ems, sample_ems) / pdf_light;
+            float pdf_emsE = emitter->pdf(lRecR_ems) * pdf_light;
+            
+            // Angle between direction from x to p and shading normal
+            float cosTheta_ems = Frame::cosTheta(itsE.shFrame.toLocal(lRecR_ems.wi));
+            
+            // Query for the BSDF
+            BSDFQueryRecord bRec_ems = BSDFQueryRecord(itsE.shFrame.toLocal(-ray.d), itsE.shFrame.toLocal(lRecR_ems.wi), ESolidAngle);
+            
+            // Get the BSDF value
+            Color3f BSDF_ems = bsdf->eval(bRec_ems);
+            float pdf_emsB = bsdf->pdf(bRec_ems);
+            
+            // Set the uv coordinates of the query
+            bRec_ems.uv = itsE.uv;
+            
+            // Check the shadowray
+            float obstacle = 1.f;
+            if (scene->rayIntersect(lRecR_ems.shadowRay)) {
+                obstacle = 0.f;
+            }
+            
+            float w_em = 0.f;
+            if ( pdf_emsE + pdf_emsB != 0.f ) {
+                w_em = pdf_emsE / (pdf_emsE + pdf_emsB);
+            }
+            L_ems = w_em * obstacle * radiance_ems * BSDF_ems * std::max(0.f,cosTheta_ems);
         }
         
         /* BSDF Sampling */
@@ -64,8 +82,9 @@ public:
         // Use BSDF Sampling and shoot a ray in that direction
         BSDFQueryRecord bRec_mats(itsE.shFrame.toLocal(-ray.d));
         bRec_mats.uv = itsE.uv;
-        Color3f BSDF_mats = itsE.mesh->getBSDF()->sample(bRec_mats, sampler->next2D());
-        float pdf_matsB = itsE.mesh->getBSDF()->pdf(bRec_mats);
+        Color3f BSDF_mats = bsdf->sample(bRec_mats, samples[1]);
+        bool specular = bRec_mats.measure == EDiscrete;
+        float pdf_matsB = bRec_mats.pdf;
         Ray3f rayR = Ray3f(itsE.p, itsE.toWorld(bRec_mats.wo));
         
         // Check light emitted in that direction
@@ -77,21 +96,24 @@ public:
             if(itsR.mesh->isEmitter()) {
                 EmitterQueryRecord lRecR_mats(itsE.p, itsR.p, itsR.shFrame.n);
                 radiance_mats = itsR.mesh->getEmitter()->eval(lRecR_mats);
-                pdf_matsE = itsR.mesh->getEmitter()->pdf(lRecR_mats);
+                // Emitter sampling cannot produce a specular direction
+                if (!specular) {
+                    pdf_matsE = itsR.mesh->getEmitter()->pdf(lRecR_mats)
+                        * scene->pdfEmitter(itsE.p, itsE.shFrame.n, itsR.mesh->getEmitter());
+                }
                 cosTheta_mats = Frame::cosTheta(itsE.shFrame.toLocal(lRecR_mats.wi));
             }
         }
         
-        float w_em(0.f), w_mat(0.f);
+        float w_mat(0.f);
         
-        if ( pdf_emsE + pdf_emsB != 0.f ) {
-            w_em = pdf_emsE / (pdf_emsE + pdf_emsB);
-        }
-        if ( pdf_matsE != 0.f + pdf_matsB != 0.f ) {
+        if (specular) {
+            w_mat = 1.f;
+        } else if (pdf_matsE + pdf_matsB != 0.f) {
             w_mat = pdf_matsB / (pdf_matsE + pdf_matsB) ;
         }
 
-        return Le + w_em * obstacle * radiance_ems * BSDF_ems * std::max(0.f,cosTheta_ems) + w_mat * radiance_mats * BSDF_mats;
+        return Le + L_ems + w_mat * radiance_mats * BSDF_mats;
     }
     
     std::string toString() const {
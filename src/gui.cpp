@@ -34,12 +34,15 @@ NORI_NAMESPACE_BEGIN
 
 #define PANEL_HEIGHT 48
 
-NoriScreen::NoriScreen(ImageBlock &block)
+NoriScreen::NoriScreen(ImageBlock &block, const RenderOptions &options)
  : nanogui::Screen(block.getSize() + Vector2i(0, PANEL_HEIGHT), "Nori", false),
-   m_block(block), m_renderThread(m_block)
+   m_block(block), m_renderThread(m_block), m_options(options)
 {
     using namespace nanogui;
 
+    /* Show denoised previews of scenes that are denoised (toggle with 'D') */
+    m_renderThread.setDenoisePreview(true);
+
     /* Add some UI elements to adjust the exposure value */
     panel = new Widget(this);
     panel->setLayout(new BoxLayout(BoxLayout::Horizontal, BoxLayout::Middle, 10, 10));
@@ -140,17 +143,23 @@ NoriScreen::~NoriScreen() {
 }
 
 void NoriScreen::drawContents() {
-    /* Reload the partially rendered image onto the GPU */
+    /* Reload the partially rendered image (or its denoised preview) onto the GPU */
     m_block.lock();
     int borderSize = m_block.getBorderSize();
-    const Vector2i &size = m_block.getSize();
+    const Vector2i size = m_block.getSize();
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, m_texture);
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, m_block.cols());
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, size.x(), size.y(),
-            0, GL_RGBA, GL_FLOAT, (uint8_t *) m_block.data() +
-            (borderSize * m_block.cols() + borderSize) * sizeof(Color4f));
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    if (m_renderThread.getDenoisedPreview(m_preview) &&
+        m_preview.cols() == size.x() && m_preview.rows() == size.y()) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, size.x(), size.y(),
+                0, GL_RGB, GL_FLOAT, (uint8_t *) m_preview.data());
+    } else {
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, m_block.cols());
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, size.x(), size.y(),
+                0, GL_RGBA, GL_FLOAT, (uint8_t *) m_block.data() +
+                (borderSize * m_block.cols() + borderSize) * sizeof(Color4f));
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    }
     m_block.unlock();
 
     m_progressBar->setValue(m_renderThread.getProgress());
@@ -193,6 +202,10 @@ bool NoriScreen::keyboardEvent(int key, int scancode, bool press, int modifiers)
         m_renderThread.stopRendering();
         return true;
     }
+    if(press && key == GLFW_KEY_D && !modifiers) {
+        m_renderThread.setDenoisePreview(!m_renderThread.getDenoisePreview());
+        return true;
+    }
 
     return nanogui::Screen::keyboardEvent(key,scancode,press,modifiers);
 }
@@ -206,7 +219,7 @@ void NoriScreen::openXML(const std::string &filename) {
 
     try {
 
-        m_renderThread.renderScene(filename);
+        m_renderThread.renderScene(filename, m_options);
 
         m_block.lock();
         Vector2i bsize = m_block.getSize();
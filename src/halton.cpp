@@ -0,0 +1,113 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <nori/sampler.h>
+#include <nori/block.h>
+#include <nori/qmc.h>
+
+NORI_NAMESPACE_BEGIN
+
+/// Bases of the Halton dimensions
+static const uint32_t haltonPrimes[] = {
+      2,   3,   5,   7,  11,  13,  17,  19,  23,  29,  31,  37,  41,  43,  47,  53,
+     59,  61,  67,  71,  73,  79,  83,  89,  97, 101, 103, 107, 109, 113, 127, 131,
+    137, 139, 149, 151, 157, 163, 167, 173, 179, 181, 191, 193, 197, 199, 211, 223,
+    227, 229, 233, 239, 241, 251, 257, 263, 269, 271, 277, 281, 283, 293, 307, 311
+};
+
+static const uint32_t haltonDimensions = sizeof(haltonPrimes) / sizeof(haltonPrimes[0]);
+
+/**
+ * Randomized Halton sampling
+ *
+ * Dimension \a d of the sample with index \a i is the radical inverse of
+ * \a i in the base of the d-th prime. The digits are Owen-scrambled with
+ * a seed that depends on the pixel and the dimension, which removes the
+ * correlation between the higher dimensions of the plain sequence and
+ * decorrelates neighbouring pixels. Dimensions beyond the prime table
+ * fall back to hashed uniform random numbers.
+ */
+class Halton final : public SamplerImpl<Halton> {
+public:
+    Halton(const PropertyList &propList) {
+        m_sampleCount = (size_t) propList.getInteger("sampleCount", 1);
+        m_seed = (uint32_t) propList.getInteger("seed", 0);
+    }
+
+    virtual ~Halton() { }
+
+    std::unique_ptr<Sampler> clone() const {
+        std::unique_ptr<Halton> cloned(new Halton());
+        cloned->m_sampleCount = m_sampleCount;
+        cloned->m_seedOffset = m_seedOffset;
+        cloned->m_seed = m_seed;
+        cloned->m_pixel = m_pixel;
+        cloned->m_sampleIndex = m_sampleIndex;
+        cloned->m_dimension = m_dimension;
+        return cloned;
+    }
+
+    void prepare(const ImageBlock &block) {
+        startPixelSample(block.getOffset(), 0, 0);
+    }
+
+    void startPixelSample(const Point2i &pixel, uint32_t sampleIndex, uint32_t dimension) {
+        m_pixel = pixel;
+        m_sampleIndex = sampleIndex;
+        m_dimension = dimension;
+    }
+
+    void generate() { m_dimension = 0; }
+    void advance()  { ++m_sampleIndex; m_dimension = 0; }
+
+    float next1D() {
+        return sample(m_dimension++);
+    }
+
+    Point2f next2D() {
+        float x = sample(m_dimension++);
+        return Point2f(x, sample(m_dimension++));
+    }
+
+    /* All state is set by startPixelSample() */
+    void serialize(std::ostream &stream) const { }
+    void unserialize(std::istream &stream) { }
+
+    virtual std::string toString() const override {
+        return tfm::format("Halton[sampleCount=%i, seed=%i]", m_sampleCount, m_seed);
+    }
+protected:
+    Halton() { }
+
+    /// Return dimension \c dimension of the current sample
+    float sample(uint32_t dimension) const {
+        uint64_t hash = QMC::hash(m_pixel, dimension, m_seed + m_seedOffset);
+        if (dimension >= haltonDimensions)
+            return QMC::toFloat(QMC::hash(hash, m_sampleIndex));
+        return QMC::owenScrambledRadicalInverse(haltonPrimes[dimension], m_sampleIndex, hash);
+    }
+
+private:
+    uint32_t m_seed = 0;
+    Point2i m_pixel = Point2i(0, 0);
+    uint32_t m_sampleIndex = 0;
+    uint32_t m_dimension = 0;
+};
+
+NORI_REGISTER_CLASS(Halton, "halton");
+NORI_NAMESPACE_END
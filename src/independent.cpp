@@ -30,7 +30,7 @@ NORI_NAMESPACE_BEGIN
  * number generator. For more details on what sample generators do in
  * general, refer to the \ref Sampler class.
  */
-class Independent : public Sampler {
+class Independent final : public SamplerImpl<Independent> {
 public:
     Independent(const PropertyList &propList) {
         m_sampleCount = (size_t) propList.getInteger("sampleCount", 1);
@@ -41,13 +41,14 @@ public:
     std::unique_ptr<Sampler> clone() const {
         std::unique_ptr<Independent> cloned(new Independent());
         cloned->m_sampleCount = m_sampleCount;
+        cloned->m_seedOffset = m_seedOffset;
         cloned->m_random = m_random;
         return std::move(cloned);
     }
 
     void prepare(const ImageBlock &block) {
         m_random.seed(
-            block.getOffset().x(),
+            block.getOffset().x() + ((uint64_t) m_seedOffset << 32),
             block.getOffset().y()
         );
     }
@@ -66,6 +67,16 @@ public:
         );
     }
 
+    void serialize(std::ostream &stream) const {
+        stream.write((const char *) &m_random.state, sizeof(m_random.state));
+        stream.write((const char *) &m_random.inc, sizeof(m_random.inc));
+    }
+
+    void unserialize(std::istream &stream) {
+        stream.read((char *) &m_random.state, sizeof(m_random.state));
+        stream.read((char *) &m_random.inc, sizeof(m_random.inc));
+    }
+
     virtual std::string toString() const override {
         return tfm::format("Independent[sampleCount=%i]", m_sampleCount);
     }
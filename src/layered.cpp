@@ -93,16 +93,21 @@ public:
             // Reflection
             bRec.wo = Vector3f(-bRec.wi.x(),-bRec.wi.y(),bRec.wi.z());
             bRec.eta = 1.0f;
+            bRec.measure = EDiscrete;
+            bRec.sampledLobe = EDeltaReflection;
+            bRec.pdf = 0.0f;
             return Color3f(1.f);
         }
         else {
             // Refraction
             BSDFQueryRecord bRec_t(transmit_i);
+            bRec_t.uv = bRec.uv;
+            bRec_t.p = bRec.p;
             Color3f BSDF = m_bsdf->sample(bRec_t, sample);
-            bRec = BSDFQueryRecord(bRec.wi, bRec_t.wo, EUnknownMeasure);
             bRec.eta = bRec_t.eta;
             bRec.measure = bRec_t.measure;
-            Vector3f transmit_o = bRec.wo;
+            bRec.sampledLobe = bRec_t.sampledLobe;
+            Vector3f transmit_o = bRec_t.wo;
             
             // Compute refraction in the other direction, can't swap because const
             float cosTheta;
@@ -113,10 +118,18 @@ public:
                     (1 / std::abs(Frame::cosTheta(transmit_i)) +
                      1 / std::abs(Frame::cosTheta(transmit_o))));
             
+            // Same as pdf(), which maps bRec.wo back onto transmit_o
+            bRec.pdf = bRec_t.pdf * (through_o != 1.f);
+            
             return BSDF * (1 - through_i) * (1 - through_o);
         }
     }
     
+    /// Specular reflection off the coating, plus the smooth lobes of the base
+    virtual uint32_t getFlags() const override {
+        return EDeltaReflection | (m_bsdf->getFlags() & ESmooth);
+    }
+
     float refraction(const Vector3f &wi, Vector3f &wt) const {
         float cosTheta;
         float th = fresnelDielCos(abs(Frame::cosTheta(wi)), cosTheta, m_extIOR, m_intIOR);
@@ -0,0 +1,381 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob, Romain Prévost
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <nori/lighttree.h>
+#include <nori/emitter.h>
+#include <nori/timer.h>
+#include <Eigen/Geometry>
+
+NORI_NAMESPACE_BEGIN
+
+/* Number of buckets used to evaluate split candidates */
+#define NORI_LIGHTTREE_BUCKETS 12
+
+static float safeSqrt(float value) {
+    return std::sqrt(std::max(0.0f, value));
+}
+
+static float safeAcos(float value) {
+    return std::acos(clamp(value, -1.0f, 1.0f));
+}
+
+/* cos(max(0, a - b)) expressed in terms of the sines/cosines of a and b */
+static float cosSubClamped(float sinA, float cosA, float sinB, float cosB) {
+    if (cosA > cosB)
+        return 1.0f;
+    return cosA * cosB + sinA * sinB;
+}
+
+/* sin(max(0, a - b)) expressed in terms of the sines/cosines of a and b */
+static float sinSubClamped(float sinA, float cosA, float sinB, float cosB) {
+    if (cosA > cosB)
+        return 0.0f;
+    return sinA * cosB - cosA * sinB;
+}
+
+float LightBounds::importance(const Point3f &p, const Normal3f &n) const {
+    if (phi == 0.0f)
+        return 0.0f;
+
+    /* Distance to the center of the bounds, clamped to avoid
+       a singularity when the point lies inside of them */
+    Point3f pc = bbox.getCenter();
+    float radius = 0.5f * bbox.getExtents().norm();
+    float dist2 = std::max((p - pc).squaredNorm(), radius * radius);
+
+    /* Angle between the cone axis and the direction to the point */
+    Vector3f wi = p - pc;
+    float len = wi.norm();
+    if (len > 0.0f)
+        wi /= len;
+    float cosTheta_w = w.dot(wi);
+    if (twoSided)
+        cosTheta_w = std::abs(cosTheta_w);
+    float sinTheta_w = safeSqrt(1.0f - cosTheta_w * cosTheta_w);
+
+    /* Bound the angle subtended by the bounding box as seen from p */
+    float cosTheta_b = -1.0f;
+    if (!bbox.contains(p) && len > radius)
+        cosTheta_b = safeSqrt(1.0f - radius * radius / (len * len));
+    float sinTheta_b = safeSqrt(1.0f - cosTheta_b * cosTheta_b);
+
+    /* Minimum angle between the emission cone and the direction to p */
+    float sinTheta_o = safeSqrt(1.0f - cosTheta_o * cosTheta_o);
+    float cosTheta_x = cosSubClamped(sinTheta_w, cosTheta_w, sinTheta_o, cosTheta_o);
+    float sinTheta_x = sinSubClamped(sinTheta_w, cosTheta_w, sinTheta_o, cosTheta_o);
+    float cosTheta_p = cosSubClamped(sinTheta_x, cosTheta_x, sinTheta_b, cosTheta_b);
+    if (cosTheta_p <= cosTheta_e)
+        return 0.0f;
+
+    float result = phi * cosTheta_p / dist2;
+
+    /* Account for the cosine factor at the receiver */
+    if (!n.isZero()) {
+        float cosTheta_i = std::abs(wi.dot(n));
+        float sinTheta_i = safeSqrt(1.0f - cosTheta_i * cosTheta_i);
+        result *= cosSubClamped(sinTheta_i, cosTheta_i, sinTheta_b, cosTheta_b);
+    }
+
+    return std::max(result, 0.0f);
+}
+
+LightBounds LightBounds::merge(const LightBounds &a, const LightBounds &b) {
+    if (a.phi == 0.0f)
+        return b;
+    if (b.phi == 0.0f)
+        return a;
+
+    LightBounds result;
+    result.bbox = BoundingBox3f::merge(a.bbox, b.bbox);
+    result.phi = a.phi + b.phi;
+    result.cosTheta_e = std::min(a.cosTheta_e, b.cosTheta_e);
+    result.twoSided = a.twoSided || b.twoSided;
+
+    /* Compute the smallest cone containing both normal cones */
+    float theta_a = safeAcos(a.cosTheta_o), theta_b = safeAcos(b.cosTheta_o);
+    float theta_d = safeAcos(a.w.dot(b.w));
+
+    if (std::min(theta_d + theta_b, M_PI) <= theta_a) {
+        result.w = a.w;
+        result.cosTheta_o = a.cosTheta_o;
+        return result;
+    }
+    if (std::min(theta_d + theta_a, M_PI) <= theta_b) {
+        result.w = b.w;
+        result.cosTheta_o = b.cosTheta_o;
+        return result;
+    }
+
+    float theta_o = 0.5f * (theta_a + theta_d + theta_b);
+    Vector3f wr = a.w.cross(b.w);
+    if (theta_o >= M_PI || wr.squaredNorm() == 0.0f) {
+        /* The cone covers the entire sphere */
+        result.w = a.w;
+        result.cosTheta_o = -1.0f;
+        return result;
+    }
+
+    /* Rotate a's axis towards b's by the angle theta_o - theta_a */
+    result.w = Eigen::AngleAxisf(theta_o - theta_a, wr.normalized()) * a.w;
+    result.cosTheta_o = std::cos(theta_o);
+    return result;
+}
+
+std::string LightBounds::toString() const {
+    return tfm::format(
+        "LightBounds[bbox=%s, w=%s, phi=%f, cosTheta_o=%f, cosTheta_e=%f, twoSided=%s]",
+        bbox.toString(), w.toString(), phi, cosTheta_o, cosTheta_e,
+        twoSided ? "true" : "false");
+}
+
+/* Cost of a split candidate according to the surface area orientation heuristic */
+static float orientationCost(const LightBounds &lb, const BoundingBox3f &centroidBounds, int axis) {
+    float theta_o = safeAcos(lb.cosTheta_o), theta_e = safeAcos(lb.cosTheta_e);
+    float theta_w = std::min(theta_o + theta_e, M_PI);
+    float sinTheta_o = safeSqrt(1.0f - lb.cosTheta_o * lb.cosTheta_o);
+    float M_omega = 2 * M_PI * (1 - lb.cosTheta_o) + M_PI / 2 *
+        (2 * theta_w * sinTheta_o - std::cos(theta_o - 2 * theta_w) -
+         2 * theta_o * sinTheta_o + lb.cosTheta_o);
+
+    /* Penalize splits along a short axis of the parent */
+    Vector3f extents = centroidBounds.getExtents();
+    float Kr = extents[axis] > 0 ? extents.maxCoeff() / extents[axis] : 0.0f;
+
+    return lb.phi * M_omega * Kr * lb.bbox.getSurfaceArea();
+}
+
+void LightTree::clear() {
+    m_nodes.clear();
+    m_emitters.clear();
+    m_infinite.clear();
+    m_bitTrails.clear();
+}
+
+void LightTree::build(const std::vector<Emitter *> &emitters) {
+    clear();
+
+    std::vector<std::pair<const Emitter *, LightBounds>> lights;
+    for (const Emitter *emitter : emitters) {
+        LightBounds bounds;
+        if (!emitter->getLightBounds(bounds))
+            m_infinite.push_back(emitter);
+        else if (bounds.phi > 0)
+            lights.push_back(std::make_pair(emitter, bounds));
+    }
+
+    if (lights.empty())
+        return;
+
+    cout << "Constructing a light tree (" << lights.size()
+         << (lights.size() == 1 ? " emitter" : " emitters") << ") .. ";
+    cout.flush();
+    Timer timer;
+
+    m_nodes.reserve(2 * lights.size() - 1);
+    buildRecursive(lights, 0u, (uint32_t) lights.size(), 0u, 0);
+
+    cout << "done (took " << timer.elapsedString() << ", "
+         << m_nodes.size() << " nodes)." << endl;
+}
+
+uint32_t LightTree::buildRecursive(std::vector<std::pair<const Emitter *, LightBounds>> &lights,
+        uint32_t start, uint32_t end, uint64_t bitTrail, int depth) {
+    if (depth >= 64)
+        throw NoriException("LightTree::build(): maximum depth exceeded!");
+
+    if (end - start == 1) {
+        /* Create a leaf node */
+        uint32_t nodeIndex = (uint32_t) m_nodes.size();
+        LightNode node;
+        node.bounds = lights[start].second;
+        node.index = (uint32_t) m_emitters.size();
+        node.leaf = true;
+        m_nodes.push_back(node);
+        m_emitters.push_back(lights[start].first);
+        m_bitTrails[lights[start].first] = bitTrail;
+        return nodeIndex;
+    }
+
+    /* Bounds of the emitters and of their centroids */
+    BoundingBox3f bbox, centroidBounds;
+    for (uint32_t i = start; i < end; ++i) {
+        const LightBounds &lb = lights[i].second;
+        bbox.expandBy(lb.bbox);
+        centroidBounds.expandBy(lb.bbox.getCenter());
+    }
+
+    /* Evaluate bucketed split candidates along all three axes */
+    float minCost = std::numeric_limits<float>::infinity();
+    int minAxis = -1, minBucket = -1;
+    for (int axis = 0; axis < 3; ++axis) {
+        float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+        if (extent <= 0)
+            continue;
+
+        LightBounds buckets[NORI_LIGHTTREE_BUCKETS];
+        for (uint32_t i = start; i < end; ++i) {
+            const LightBounds &lb = lights[i].second;
+            int b = (int) (NORI_LIGHTTREE_BUCKETS *
+                (lb.bbox.getCenter()[axis] - centroidBounds.min[axis]) / extent);
+            b = clamp(b, 0, NORI_LIGHTTREE_BUCKETS - 1);
+            buckets[b] = LightBounds::merge(buckets[b], lb);
+        }
+
+        for (int i = 0; i < NORI_LIGHTTREE_BUCKETS - 1; ++i) {
+            LightBounds left, right;
+            for (int j = 0; j <= i; ++j)
+                left = LightBounds::merge(left, buckets[j]);
+            for (int j = i + 1; j < NORI_LIGHTTREE_BUCKETS; ++j)
+                right = LightBounds::merge(right, buckets[j]);
+
+            float cost = orientationCost(left, bbox, axis) +
+                         orientationCost(right, bbox, axis);
+            if (cost > 0 && cost < minCost) {
+                minCost = cost;
+                minAxis = axis;
+                minBucket = i;
+            }
+        }
+    }
+
+    uint32_t mid;
+    if (minAxis == -1) {
+        /* All centroids coincide -- split in the middle */
+        mid = (start + end) / 2;
+    } else {
+        float extent = centroidBounds.max[minAxis] - centroidBounds.min[minAxis];
+        auto it = std::partition(lights.begin() + start, lights.begin() + end,
+            [&](const std::pair<const Emitter *, LightBounds> &l) {
+                int b = (int) (NORI_LIGHTTREE_BUCKETS *
+                    (l.second.bbox.getCenter()[minAxis] - centroidBounds.min[minAxis]) / extent);
+                return clamp(b, 0, NORI_LIGHTTREE_BUCKETS - 1) <= minBucket;
+            });
+        mid = (uint32_t) (it - lights.begin());
+        if (mid == start || mid == end)
+            mid = (start + end) / 2;
+    }
+
+    /* Create an inner node; the left child immediately follows it */
+    uint32_t nodeIndex = (uint32_t) m_nodes.size();
+    m_nodes.push_back(LightNode());
+    buildRecursive(lights, start, mid, bitTrail, depth + 1);
+    uint32_t rightChild = buildRecursive(lights, mid, end,
+        bitTrail | (uint64_t(1) << depth), depth + 1);
+
+    LightNode &node = m_nodes[nodeIndex];
+    node.bounds = LightBounds::merge(m_nodes[nodeIndex + 1].bounds,
+                                     m_nodes[rightChild].bounds);
+    node.index = rightChild;
+    node.leaf = false;
+    return nodeIndex;
+}
+
+float LightTree::infiniteProbability() const {
+    if (m_infinite.empty())
+        return 0.0f;
+    return m_infinite.size() / (float) (m_infinite.size() + (m_nodes.empty() ? 0 : 1));
+}
+
+const Emitter *LightTree::sample(const Point3f &p, const Normal3f &n,
+        float sample, float &pdf) const {
+    /* Decide between the unbounded emitters and the tree */
+    float pInfinite = infiniteProbability();
+    if (sample < pInfinite) {
+        size_t index = std::min((size_t) (sample / pInfinite * m_infinite.size()),
+                                m_infinite.size() - 1);
+        pdf = pInfinite / m_infinite.size();
+        return m_infinite[index];
+    }
+
+    if (m_nodes.empty())
+        return nullptr;
+
+    sample = std::min((sample - pInfinite) / (1 - pInfinite), 1.0f - Epsilon);
+    pdf = 1 - pInfinite;
+
+    uint32_t nodeIndex = 0;
+    while (true) {
+        const LightNode &node = m_nodes[nodeIndex];
+        if (node.leaf) {
+            if (nodeIndex > 0 || node.bounds.importance(p, n) > 0)
+                return m_emitters[node.index];
+            return nullptr;
+        }
+
+        float ci0 = m_nodes[nodeIndex + 1].bounds.importance(p, n);
+        float ci1 = m_nodes[node.index].bounds.importance(p, n);
+        if (ci0 == 0 && ci1 == 0)
+            return nullptr;
+
+        /* Descend into one of the children and reuse the sample */
+        float p0 = ci0 / (ci0 + ci1);
+        if (sample < p0) {
+            sample = std::min(sample / p0, 1.0f - Epsilon);
+            pdf *= p0;
+            nodeIndex = nodeIndex + 1;
+        } else {
+            sample = std::min((sample - p0) / (1 - p0), 1.0f - Epsilon);
+            pdf *= 1 - p0;
+            nodeIndex = node.index;
+        }
+    }
+}
+
+float LightTree::pdf(const Point3f &p, const Normal3f &n, const Emitter *emitter) const {
+    float pInfinite = infiniteProbability();
+    auto it = m_bitTrails.find(emitter);
+    if (it == m_bitTrails.end()) {
+        if (std::find(m_infinite.begin(), m_infinite.end(), emitter) != m_infinite.end())
+            return pInfinite / m_infinite.size();
+        return 0.0f;
+    }
+
+    /* Follow the path from the root to the emitter's leaf */
+    uint64_t bitTrail = it->second;
+    float pdf = 1 - pInfinite;
+    uint32_t nodeIndex = 0;
+    while (!m_nodes[nodeIndex].leaf) {
+        const LightNode &node = m_nodes[nodeIndex];
+        float ci0 = m_nodes[nodeIndex + 1].bounds.importance(p, n);
+        float ci1 = m_nodes[node.index].bounds.importance(p, n);
+        if (ci0 == 0 && ci1 == 0)
+            return 0.0f;
+
+        if (bitTrail & 1) {
+            pdf *= ci1 / (ci0 + ci1);
+            nodeIndex = node.index;
+        } else {
+            pdf *= ci0 / (ci0 + ci1);
+            nodeIndex = nodeIndex + 1;
+        }
+        bitTrail >>= 1;
+    }
+
+    if (nodeIndex == 0 && m_nodes[0].bounds.importance(p, n) == 0)
+        return 0.0f;
+
+    return pdf;
+}
+
+std::string LightTree::toString() const {
+    return tfm::format(
+        "LightTree[nodes=%i, emitters=%i, infinite=%i]",
+        m_nodes.size(), m_emitters.size(), m_infinite.size());
+}
+
+NORI_NAMESPACE_END
@@ -17,22 +17,306 @@
 */
 
 #include <nori/block.h>
+#include <nori/aov.h>
 #include <nori/gui.h>
 #include <filesystem/path.h>
+#include <csignal>
+
+using namespace nori;
+
+static void printUsage() {
+    cerr << "Syntax: nori [options] <scene.xml | image.exr>" << endl
+         << "Options:" << endl
+         << "  --headless          Render without opening a window and exit. Only a" << endl
+         << "                      JSON summary goes to stdout, all messages to stderr" << endl
+         << "  --threads <n>       Number of worker threads (default: one per core)" << endl
+         << "  --numa-node <n>     Only run on the CPUs of the given NUMA node" << endl
+         << "  --pin-threads       Pin every worker thread to a single CPU" << endl
+         << "  --spp <n>           Override the number of samples per pixel" << endl
+         << "  --output <file>     Name of the output EXR file" << endl
+         << "  --resolution <WxH>  Override the image resolution" << endl
+         << "  --crop <x,y,w,h>    Only render the given pixel rectangle" << endl
+         << "  --crop-output       Only save the crop window instead of a full-size image" << endl
+         << "  --time <seconds>    Render as many samples as fit into a time budget" << endl
+         << "  --checkpoint <file> Periodically save the progress to a checkpoint file" << endl
+         << "  --checkpoint-interval <seconds>" << endl
+         << "                      Time between two checkpoints (default: 60)" << endl
+         << "  --resume            Continue from the checkpoint file if it exists" << endl
+         << "  --snapshot <file>   Periodically save the image in progress (EXR, or PNG" << endl
+         << "                      for a .png name) without stalling the rendering" << endl
+         << "  --snapshot-interval <seconds>" << endl
+         << "                      Time between two snapshots (default: 10)" << endl
+         << "  --snapshot-passes <n>" << endl
+         << "                      Passes between two snapshots (instead of the interval," << endl
+         << "                      unless both are given)" << endl
+         << "  --frames <n>        Render n frames along the camera keys of the scene" << endl
+         << "  --turntable         Orbit the camera around the scene over the frames" << endl
+         << "  --aovs <list>       Also save AOVs as EXR layers, e.g. albedo,normal,depth" << endl
+         << "                      (also: position, direct, indirect, variance, sampleCount)" << endl
+         << "  --denoise           Denoise the image (the noisy one is kept as a layer)" << endl
+         << "Distributed rendering (combine the partial files with nori-merge):" << endl
+         << "  --partial <file>    Save the unnormalized accumulation instead of an EXR" << endl
+         << "  --worker <i/n>      Only render the tiles of worker i out of n" << endl
+         << "  --sample-offset <n> Index of the first pixel sample (default: 0)" << endl
+         << "  --seed-offset <n>   Offset of the sampler's seed (default: 0)" << endl
+         << "Except for the thread settings, the overrides require --headless." << endl;
+}
+
+/// Parse a positive integer command line argument
+static int parseCount(const std::string &str) {
+    char *end = nullptr;
+    long value = std::strtol(str.c_str(), &end, 10);
+    if (*end != '\0' || value <= 0)
+        throw NoriException("Expected a positive integer, got \"%s\"", str);
+    return (int) value;
+}
+
+/// Parse a non-negative integer command line argument
+static int parseIndex(const std::string &str) {
+    char *end = nullptr;
+    long value = std::strtol(str.c_str(), &end, 10);
+    if (*end != '\0' || value < 0 || value > std::numeric_limits<int>::max())
+        throw NoriException("Expected a non-negative integer, got \"%s\"", str);
+    return (int) value;
+}
+
+/// Parse a positive real-valued command line argument
+static float parsePositive(const std::string &str) {
+    char *end = nullptr;
+    float value = std::strtof(str.c_str(), &end);
+    if (*end != '\0' || !(value > 0))
+        throw NoriException("Expected a positive number, got \"%s\"", str);
+    return value;
+}
+
+/// Escape a string for use in a JSON document
+static std::string jsonString(const std::string &str) {
+    std::string result = "\"";
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+            result += c;
+        } else if (c == '\n') {
+            result += "\\n";
+        } else if (c == '\t') {
+            result += "\\t";
+        } else if ((unsigned char) c < 0x20) {
+            /* Other control characters are not allowed in JSON strings */
+            result += tfm::format("\\u%04x", (int) (unsigned char) c);
+        } else {
+            result += c;
+        }
+    }
+    return result + "\"";
+}
+
+/// Rendering of \ref renderHeadless(), which SIGINT and SIGTERM interrupt
+static RenderThread *headlessRender = nullptr;
+
+static void stopHeadless(int) {
+    if (headlessRender)
+        headlessRender->requestStop();
+}
+
+/**
+ * \brief Render a scene without a user interface
+ *
+ * Prints a single line of JSON with the timings to stdout once the image
+ * has been written (all other messages go to stderr), and returns the
+ * process exit status.
+ */
+static int renderHeadless(const std::string &filename, const RenderOptions &options) {
+    ImageBlock block(Vector2i(720, 720), nullptr);
+    RenderThread renderThread(block);
+
+    /* An interrupted job saves its progress and reports a failure */
+    headlessRender = &renderThread;
+    std::signal(SIGINT, stopHeadless);
+    std::signal(SIGTERM, stopHeadless);
+
+    /* The progress messages go to stderr, so that stdout only carries
+       the JSON summary. Restored on every exit path */
+    struct Redirect {
+        std::streambuf *previous = cout.rdbuf(cerr.rdbuf());
+        ~Redirect() { cout.rdbuf(previous); }
+    } redirect;
+
+    renderThread.renderScene(filename, options);
+    renderThread.wait();
+
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+    headlessRender = nullptr;
+    cout.rdbuf(redirect.previous);
+
+    const RenderStatistics &stats = renderThread.getStatistics();
+    if (stats.outputName.empty())
+        return 0; /* Not a scene (e.g. a statistical test) */
+
+    /* Samples per pixel of every tile as [x, y, width, height, spp] */
+    std::string tiles;
+    for (const RenderStatistics::Tile &tile : stats.tiles)
+        tiles += tfm::format("%s[%i, %i, %i, %i, %i]", tiles.empty() ? "" : ", ",
+                             tile.offset.x(), tile.offset.y(), tile.size.x(),
+                             tile.size.y(), tile.samples);
+
+    /* Render time of every frame of a batch */
+    std::string frameTimes;
+    for (double time : stats.frameTimes)
+        frameTimes += tfm::format("%s%.4f", frameTimes.empty() ? "" : ", ", time);
+
+    cout << tfm::format("{\"scene\": %s, \"output\": %s, \"width\": %i, \"height\": %i, "
+                        "\"threads\": %i, \"spp\": %.4f, \"load_time\": %.4f, "
+                        "\"render_time\": %.4f, \"denoise_time\": %.4f, \"total_time\": %.4f, "
+                        "\"invalid_samples\": %i, \"snapshots\": %i, \"success\": %s, \"frames\": %i, "
+                        "\"frame_times\": [%s], \"tiles\": [%s]}",
+                        jsonString(filename), jsonString(stats.outputName),
+                        stats.size.x(), stats.size.y(), stats.threads,
+                        stats.samplesPerPixel, stats.loadTime, stats.renderTime, stats.denoiseTime,
+                        stats.loadTime + stats.renderTime + stats.denoiseTime,
+                        stats.invalidSamples, stats.snapshots, stats.success ? "true" : "false",
+                        stats.frames, frameTimes, tiles) << endl;
+
+    return stats.success ? 0 : 1;
+}
 
 int main(int argc, char **argv) {
-    using namespace nori;
+    RenderOptions options;
+    bool headless = false, overrides = false, snapshotInterval = false;
+    std::string filename;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--headless") {
+                headless = true;
+                continue;
+            } else if (arg == "--pin-threads") {
+                options.pinThreads = true;
+                continue;
+            } else if (arg == "--resume") {
+                options.resume = true;
+                overrides = true;
+                continue;
+            } else if (arg == "--turntable") {
+                options.turntable = true;
+                overrides = true;
+                continue;
+            } else if (arg == "--crop-output") {
+                options.cropOutput = true;
+                overrides = true;
+                continue;
+            } else if (arg == "--denoise") {
+                options.denoise = true;
+                overrides = true;
+                continue;
+            } else if (arg.compare(0, 2, "--") != 0) {
+                if (!filename.empty())
+                    throw NoriException("Only one file can be given");
+                filename = arg;
+                continue;
+            }
+
+            if (i + 1 >= argc)
+                throw NoriException("Missing value for option \"%s\"", arg);
+            std::string value = argv[++i];
+            if (arg == "--threads") {
+                options.threads = parseCount(value);
+                continue;
+            } else if (arg == "--numa-node") {
+                options.numaNode = parseIndex(value);
+                continue;
+            }
+
+            overrides = true;
+            if (arg == "--spp") {
+                options.sampleCount = parseCount(value);
+            } else if (arg == "--time") {
+                options.timeBudget = parsePositive(value);
+            } else if (arg == "--checkpoint") {
+                options.checkpointName = value;
+            } else if (arg == "--checkpoint-interval") {
+                options.checkpointInterval = parsePositive(value);
+            } else if (arg == "--snapshot") {
+                options.snapshotName = value;
+            } else if (arg == "--snapshot-interval") {
+                options.snapshotInterval = parsePositive(value);
+                snapshotInterval = true;
+            } else if (arg == "--snapshot-passes") {
+                options.snapshotPasses = parseCount(value);
+            } else if (arg == "--output") {
+                options.outputName = value;
+            } else if (arg == "--resolution") {
+                size_t x = value.find('x');
+                if (x == std::string::npos)
+                    throw NoriException("Expected a resolution of the form WxH, got \"%s\"", value);
+                options.resolution = Vector2i(parseCount(value.substr(0, x)),
+                                              parseCount(value.substr(x + 1)));
+            } else if (arg == "--crop") {
+                std::vector<std::string> tokens = tokenize(value, ",");
+                if (tokens.size() != 4)
+                    throw NoriException("Expected a crop window of the form x,y,w,h, got \"%s\"", value);
+                options.cropOffset = Point2i(toInt(tokens[0]), toInt(tokens[1]));
+                options.cropSize = Vector2i(parseCount(tokens[2]), parseCount(tokens[3]));
+            } else if (arg == "--frames") {
+                options.frames = parseCount(value);
+            } else if (arg == "--aovs") {
+                /* Check the names before the scene is loaded */
+                AOVRecord::parseList(value);
+                options.aovs = value;
+            } else if (arg == "--partial") {
+                options.partialName = value;
+            } else if (arg == "--worker") {
+                size_t slash = value.find('/');
+                if (slash == std::string::npos)
+                    throw NoriException("Expected a worker of the form i/n, got \"%s\"", value);
+                options.workerIndex = parseIndex(value.substr(0, slash));
+                options.workerCount = parseCount(value.substr(slash + 1));
+                if (options.workerIndex >= options.workerCount)
+                    throw NoriException("The worker index must be smaller than the worker count, got \"%s\"", value);
+            } else if (arg == "--sample-offset") {
+                options.sampleOffset = (uint32_t) parseIndex(value);
+            } else if (arg == "--seed-offset") {
+                options.seedOffset = (uint32_t) parseIndex(value);
+            } else {
+                throw NoriException("Unknown option \"%s\"", arg);
+            }
+        }
+
+        if (headless && filename.empty())
+            throw NoriException("--headless requires a scene file");
+        if (options.resume && options.checkpointName.empty())
+            throw NoriException("--resume requires --checkpoint");
+        if (options.workerCount > 1 && options.partialName.empty())
+            throw NoriException("--worker requires --partial");
+        if (options.snapshotPasses > 0 && !snapshotInterval)
+            options.snapshotInterval = 0.f;
+        if (overrides && !headless)
+            throw NoriException("Render settings can only be overridden with --headless");
+    } catch (const std::exception &e) {
+        cerr << "Error: " << e.what() << endl;
+        printUsage();
+        return 2;
+    }
+
+    if (headless) {
+        try {
+            return renderHeadless(filename, options);
+        } catch (const std::exception &e) {
+            cerr << "Fatal error: " << e.what() << endl;
+            return 1;
+        }
+    }
 
     try {
         nanogui::init();
 
         // Open the UI with a dummy image
         ImageBlock block(Vector2i(720, 720), nullptr);
-        NoriScreen *screen = new NoriScreen(block);
+        NoriScreen *screen = new NoriScreen(block, options);
 
         // if file is passed as argument, handle it
-        if (argc == 2) {
-            std::string filename = argv[1];
+        if (!filename.empty()) {
             filesystem::path path(filename);
 
             if (path.extension() == "xml") {
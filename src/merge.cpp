@@ -0,0 +1,90 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <nori/checkpoint.h>
+#include <nori/bitmap.h>
+#include <memory>
+#include <vector>
+
+/**
+ * Combine the partial renderings of a distributed rendering
+ *
+ * Every worker runs <tt>nori --headless --partial FILE</tt> with its own
+ * share of the tiles (<tt>--worker i/n</tt>) and/or its own range of pixel
+ * samples (<tt>--sample-offset</tt>, <tt>--seed-offset</tt>). This tool sums
+ * the unnormalized colors and filter weights of all partials and divides
+ * only once, so the merged image is normalized exactly as if all samples
+ * had been rendered by a single process.
+ */
+int main(int argc, char **argv) {
+    using namespace nori;
+
+    if (argc < 3) {
+        cerr << "Syntax: nori-merge <output.exr> <partial> [<partial> ..]" << endl;
+        return 2;
+    }
+
+    try {
+        RenderPartial merged;
+        merged.load(argv[2]);
+
+        /* Configurations of all partials so far (identical configurations
+           would render identical samples) */
+        struct Configuration {
+            uint32_t sampleOffset, seedOffset;
+            int workerIndex, workerCount;
+            const char *filename;
+
+            Configuration(const RenderPartial &p, const char *filename)
+                : sampleOffset(p.sampleOffset), seedOffset(p.seedOffset),
+                  workerIndex(p.workerIndex), workerCount(p.workerCount), filename(filename) { }
+
+            bool operator==(const Configuration &c) const {
+                return sampleOffset == c.sampleOffset && seedOffset == c.seedOffset &&
+                       workerIndex == c.workerIndex && workerCount == c.workerCount;
+            }
+        };
+        std::vector<Configuration> seen;
+        seen.push_back(Configuration(merged, argv[2]));
+
+        for (int i = 3; i < argc; ++i) {
+            RenderPartial partial;
+            partial.load(argv[i]);
+
+            Configuration configuration(partial, argv[i]);
+            for (const Configuration &other : seen) {
+                if (configuration == other) {
+                    cerr << "Warning: \"" << argv[i] << "\" has the same configuration as \""
+                         << other.filename << "\" and repeats its samples" << endl;
+                    break;
+                }
+            }
+            seen.push_back(configuration);
+
+            merged.accumulate(partial);
+        }
+
+        std::unique_ptr<Bitmap> bitmap(merged.toBitmap());
+        bitmap->save(argv[1]);
+        cout << tfm::format("Merged %i partial renderings into \"%s\"", argc - 2, argv[1]) << endl;
+    } catch (const std::exception &e) {
+        cerr << "Fatal error: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
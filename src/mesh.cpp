@@ -80,6 +80,38 @@ float Mesh::surfaceArea(uint32_t index) const {
     return 0.5f * Vector3f((p1 - p0).cross(p2 - p0)).norm();
 }
 
+void Mesh::getNormalBounds(Vector3f &axis, float &cosTheta) const {
+    /* Normal of every triangle (or every vertex if available) */
+    std::vector<Vector3f> normals;
+    if (m_N.size() > 0) {
+        for (uint32_t i = 0; i < m_N.cols(); ++i)
+            normals.push_back(Vector3f(m_N.col(i)).normalized());
+    } else {
+        for (uint32_t i = 0; i < getPrimitiveCount(); ++i) {
+            const Point3f p0 = m_V.col(m_F(0, i)), p1 = m_V.col(m_F(1, i)), p2 = m_V.col(m_F(2, i));
+            Vector3f n = (p1 - p0).cross(p2 - p0);
+            if (n.squaredNorm() > 0)
+                normals.push_back(n.normalized());
+        }
+    }
+
+    /* Average direction and largest deviation from it */
+    axis = Vector3f(0.0f);
+    for (const Vector3f &n : normals)
+        axis += n;
+
+    if (axis.squaredNorm() == 0) {
+        axis = Vector3f(0.0f, 0.0f, 1.0f);
+        cosTheta = -1.0f;
+        return;
+    }
+    axis.normalize();
+
+    cosTheta = 1.0f;
+    for (const Vector3f &n : normals)
+        cosTheta = std::min(cosTheta, axis.dot(n));
+}
+
 bool Mesh::rayIntersect(uint32_t index, const Ray3f &ray, float &u, float &v, float &t) const {
     uint32_t i0 = m_F(0, index), i1 = m_F(1, index), i2 = m_F(2, index);
     const Point3f p0 = m_V.col(i0), p1 = m_V.col(i1), p2 = m_V.col(i2);
@@ -103,6 +103,30 @@ public:
         return m_ks * D * Frame::cosTheta(wh) * Jh + (1 - m_ks) * Frame::cosTheta(bRec.wo) * INV_PI;
     }
 
+    /**
+     * \brief Evaluate the BRDF together with the sampling density
+     *
+     * Equivalent to calling \ref eval() and \ref pdf(), but the half
+     * vector and the distribution term are only computed once.
+     */
+    Color3f evalAndPdf(const BSDFQueryRecord &bRec, float &pdf) const {
+        Vector3f wh = (bRec.wi + bRec.wo).normalized();
+        float cosThetaI = Frame::cosTheta(bRec.wi),
+              cosThetaO = Frame::cosTheta(bRec.wo);
+
+        float D = evalBeckmann(wh);
+        float F = fresnelDiel((wh.dot(bRec.wo)), m_extIOR, m_intIOR);
+        float G = smithBeckmannG1(bRec.wi, wh) * smithBeckmannG1(bRec.wo,wh);
+
+        pdf = 0.f;
+        if (cosThetaO > 0) {
+            float Jh = 1.f / (4.f * wh.dot(bRec.wo));
+            pdf = m_ks * D * Frame::cosTheta(wh) * Jh + (1 - m_ks) * cosThetaO * INV_PI;
+        }
+
+        return m_kd *INV_PI + m_ks * D * F * G / (4.f * cosThetaI * cosThetaO);
+    }
+
     /// Sample the BRDF
     virtual Color3f sample(BSDFQueryRecord &bRec, const Point2f &_sample) const override {
         
@@ -115,15 +139,32 @@ public:
             sample.x() /= m_ks;
             Vector3f wh = Warp::squareToBeckmann(sample, m_alpha);
             bRec.wo = ((2.f * wh.dot(bRec.wi) * wh) - bRec.wi).normalized();
+            bRec.sampledLobe = EGlossy;
         } else {
             sample.x() = (sample.x() - m_ks) / (1.0f - m_ks);
             bRec.wo = Warp::squareToCosineHemisphere(sample);
+            bRec.sampledLobe = EDiffuse;
         }
+        bRec.measure = ESolidAngle;
         
         if (Frame::cosTheta(bRec.wo) <= 0) {
             return Color3f(0.0f);
         }
-        return eval(bRec) * Frame::cosTheta(bRec.wo) / pdf(bRec);
+        Color3f value = evalAndPdf(bRec, bRec.pdf);
+        return value * Frame::cosTheta(bRec.wo) / bRec.pdf;
+    }
+
+    virtual Color3f getAlbedo(const Point2f &uv) const override {
+        return m_kd + Color3f(m_ks);
+    }
+
+    virtual uint32_t getFlags() const override {
+        uint32_t flags = 0;
+        if (m_ks > 0)
+            flags |= EGlossy;
+        if (m_ks < 1)
+            flags |= EDiffuse;
+        return flags;
     }
 
     virtual std::string toString() const override {
@@ -47,6 +47,8 @@ public:
              bRec.wi.z()
         );
         bRec.measure = EDiscrete;
+        bRec.sampledLobe = EDeltaReflection;
+        bRec.pdf = 0.0f;
 
         /* Relative index of refraction: no change */
         bRec.eta = 1.0f;
@@ -54,6 +56,10 @@ public:
         return Color3f(1.0f);
     }
 
+    virtual uint32_t getFlags() const override {
+        return EDeltaReflection;
+    }
+
     virtual std::string toString() const override {
         return "Mirror[]";
     }
@@ -40,8 +40,12 @@ public:
                 Li += t*its.mesh->getEmitter()->eval(lRec);
             }
             
+            // Random numbers of this bounce: Russian roulette and BSDF sample
+            Point2f u[2];
+            sampler->next2DArray(u, 2);
+
             // Russian roulette
-            if (sampler->next1D() > std::min(t.maxCoeff(),0.999f)) {
+            if (u[0].x() > std::min(t.maxCoeff(),0.999f)) {
                 return Li;
             }
             t /= std::min(t.maxCoeff(),0.999f);
@@ -49,7 +53,7 @@ public:
             // Use BSDF Sampling and shoot a ray in that direction
             BSDFQueryRecord bRec(its.shFrame.toLocal(-mRay.d));
             bRec.uv = its.uv;
-            BSDF = its.mesh->getBSDF()->sample(bRec, sampler->next2D());
+            BSDF = its.mesh->getBSDF()->sample(bRec, u[1]);
             mRay = Ray3f(its.p, its.toWorld(bRec.wo));
         
             // The sample function already returns the value divided by the pdf
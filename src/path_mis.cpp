@@ -2,6 +2,7 @@
 #include <nori/scene.h>
 #include <nori/bsdf.h>
 #include <nori/sampler.h>
+#include <nori/aov.h>
 
 NORI_NAMESPACE_BEGIN
 
@@ -12,28 +13,42 @@ public:
     }
     
     Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray) const {
+        return LiPixel(scene, sampler, ray, Point2i(-1, -1), nullptr);
+    }
+
+    Color3f LiPixel(const Scene *scene, Sampler *sampler, const Ray3f &ray, const Point2i &pixel,
+                    AOVRecord *aov) const {
         /* Find the surface that is visible in the requested direction */
         
         // Initial radiance and throughput
         Color3f Li(0.0f), t(1.f);
+        // Part of Li that is emitted or directly illuminates the first vertex
+        Color3f direct(0.0f);
+        int bounce = 0;
         Ray3f mRay = ray;
         
         const Emitter* env = scene->getEnvEmitter();
-        Color3f BSDF(1.0f);
         
         float pdf_matsB(0.f), pdf_matsE(0.f);
         float pdf_emsB(0.f), pdf_emsE(0.f);
         float cosTheta_ems;
         float w_mat(1.0f), w_em(1.0f);
         
+        // The intersection of the current ray is carried over from the previous bounce
+        Intersection its;
+        bool hit = scene->rayIntersect(mRay, its);
+        if (aov)
+            aov->setSurface(hit ? &its : nullptr);
+        
         while (true) {
-            Intersection its;
-            if(!scene->rayIntersect(mRay, its)) {
+            if (!hit) {
                 // No more intersection, return current Li
                 EmitterQueryRecord lRec;
                 lRec.wi = mRay.d.normalized();
                 if (env != nullptr) Li += w_mat * env->eval(lRec) * t;
-                return Li;
+                if (bounce <= 1)
+                    direct = Li;
+                break;
             }
             /*             *\
             Material Sampling
@@ -46,75 +61,102 @@ public:
                 radiance_mats = t*its.mesh->getEmitter()->eval(lRec_mats);
             }
             Li += w_mat * radiance_mats;
+            // Light arriving at the second vertex is indirect from now on
+            if (bounce <= 1)
+                direct = Li;
+
+            // All random numbers of this bounce, fetched at once: Russian roulette
+            // and light selection, emitter sample and BSDF sample
+            Point2f u[3];
+            sampler->next2DArray(u, 3);
             
             // Russian roulette
-            if (sampler->next1D() > std::min(t.maxCoeff(),0.99f)) {
-                return Li;
+            if (u[0].x() > std::min(t.maxCoeff(),0.99f)) {
+                break;
             }
             t /= std::min(t.maxCoeff(),0.99f);
             
             /*            *\
             Emitter Sampling
             \*            */
-            // Random Light
-            const Emitter* emitter = scene->getRandomEmitter(sampler->next1D());
-            // Query to get data from lights
-            EmitterQueryRecord lRec_ems(its.p);
-            // Call sample of emitter to fill query
-            Color3f radiance_ems = emitter->sample(lRec_ems, sampler->next2D())*scene->getLights().size();
-            pdf_emsE = emitter->pdf(lRec_ems);
-            // Angle between direction from x to p and normal
-            cosTheta_ems = Frame::cosTheta(its.shFrame.toLocal(lRec_ems.wi));
-            // Query for the BSDF
-            BSDFQueryRecord bRec_ems(its.shFrame.toLocal(-mRay.d),its.shFrame.toLocal(lRec_ems.wi), ESolidAngle);
-            bRec_ems.uv = its.uv;
-            // Get the BSDF value
-            Color3f BSDF_ems = its.mesh->getBSDF()->eval(bRec_ems);
-            pdf_emsB = its.mesh->getBSDF()->pdf(bRec_ems);
-            
-            // Check the shadow ray
-            Intersection its_ems;
-            if (scene->rayIntersect(lRec_ems.shadowRay, its_ems)) {
-                radiance_ems = 0.0f;
-            }
-            if (pdf_emsE + pdf_emsB != 0.0f) {
-                w_em = pdf_emsE / (pdf_emsE + pdf_emsB);
-            }
+            const BSDF* bsdf = its.mesh->getBSDF();
+            // Select a light according to the scene's light sampler,
+            // unless the surface is purely specular and cannot be lit this way
+            float pdf_light = 0.f;
+            const Emitter* emitter = nullptr;
+            Point2f sample_ems = u[1];
+            if (bsdf->hasSmoothComponent())
+                emitter = scene->sampleEmitter(its.p, its.shFrame.n, u[0].y(), pdf_light);
+            if (emitter != nullptr) {
+                // Query to get data from lights
+                EmitterQueryRecord lRec_ems(its.p);
+                // Call sample of emitter to fill query
+                Color3f radiance_ems = emitter->sample(lRec_ems, sample_ems) / pdf_light;
+                pdf_emsE = emitter->pdf(lRec_ems) * pdf_light;
+                // Angle between direction from x to p and normal
+                cosTheta_ems = Frame::cosTheta(its.shFrame.toLocal(lRec_ems.wi));
+                // Query for the BSDF
+                BSDFQueryRecord bRec_ems(its.shFrame.toLocal(-mRay.d),its.shFrame.toLocal(lRec_ems.wi), ESolidAngle);
+                bRec_ems.uv = its.uv;
+                // Get the BSDF value
+                Color3f BSDF_ems = bsdf->eval(bRec_ems);
+                pdf_emsB = bsdf->pdf(bRec_ems);
+                
+                // Check the shadow ray
+                if (scene->rayIntersect(lRec_ems.shadowRay)) {
+                    radiance_ems = 0.0f;
+                }
+                if (pdf_emsE + pdf_emsB != 0.0f) {
+                    w_em = pdf_emsE / (pdf_emsE + pdf_emsB);
+                }
 
-            Li += w_em * t * radiance_ems * BSDF_ems * std::max(0.f, cosTheta_ems);
+                Li += w_em * t * radiance_ems * BSDF_ems * std::max(0.f, cosTheta_ems);
+            }
             
             // Use BSDF Sampling and shoot a ray in that direction
             BSDFQueryRecord bRec(its.shFrame.toLocal(-mRay.d));
             bRec.uv = its.uv;
-            Color3f BSDF = its.mesh->getBSDF()->sample(bRec, sampler->next2D());
+            Color3f BSDF = bsdf->sample(bRec, u[2]);
             mRay = Ray3f(its.p, its.toWorld(bRec.wo));
-            pdf_matsB = its.mesh->getBSDF()->pdf(bRec);
             // The sample function already returns the value divided by the pdf
             t *= BSDF;
             
+            // This intersection is reused as the next path vertex
             Intersection itsR;
-            if (scene->rayIntersect(mRay, itsR)) {
-                if (itsR.mesh->isEmitter()) {
-                    EmitterQueryRecord lRec_R(its.p, itsR.p, itsR.shFrame.n);
-                    pdf_matsE = itsR.mesh->getEmitter()->pdf(lRec_R);
+            hit = scene->rayIntersect(mRay, itsR);
+            
+            if (bRec.measure == EDiscrete) {
+                // Emitter sampling cannot produce a specular direction
+                w_mat = 1.f;
+                w_em = 0.f;
+            } else {
+                pdf_matsB = bRec.pdf;
+                if (hit) {
+                    if (itsR.mesh->isEmitter()) {
+                        EmitterQueryRecord lRec_R(its.p, itsR.p, itsR.shFrame.n);
+                        pdf_matsE = itsR.mesh->getEmitter()->pdf(lRec_R)
+                            * scene->pdfEmitter(its.p, its.shFrame.n, itsR.mesh->getEmitter());
+                        if (pdf_matsE + pdf_matsB != 0.f) {
+                            w_mat = pdf_matsB / (pdf_matsB + pdf_matsE);
+                        }
+                    }
+                } else if (env != nullptr) {
+                    EmitterQueryRecord lRec_R;
+                    lRec_R.wi = mRay.d.normalized();
+                    pdf_matsE = env->pdf(lRec_R) * scene->pdfEmitter(its.p, its.shFrame.n, env);
                     if (pdf_matsE + pdf_matsB != 0.f) {
                         w_mat = pdf_matsB / (pdf_matsB + pdf_matsE);
                     }
                 }
-            } else if (env != nullptr) {
-                EmitterQueryRecord lRec_R;
-                lRec_R.wi = mRay.d.normalized();
-                pdf_matsE = env->pdf(lRec_R);
-                if (pdf_matsE + pdf_matsB != 0.f) {
-                    w_mat = pdf_matsB / (pdf_matsB + pdf_matsE);
-                }
-            }
-                
-            if (bRec.measure == EDiscrete) {
-                w_mat = 1.f;
-                w_em = 0.f;
             }
+            
+            its = itsR;
+            ++bounce;
         }
+
+        if (aov)
+            aov->setSplit(direct, Li - direct);
+        return Li;
     }
     std::string toString() const {
         return "PathMultiImportanceSampling[]";
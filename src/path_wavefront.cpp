@@ -0,0 +1,301 @@
+#include <nori/integrator.h>
+#include <nori/scene.h>
+#include <nori/bsdf.h>
+#include <nori/sampler.h>
+#include <nori/camera.h>
+#include <nori/block.h>
+#include <unordered_map>
+
+/// Sample dimensions consumed by the camera (pixel and aperture sample)
+#define NORI_WAVEFRONT_CAMERA_DIMENSIONS 4
+
+/// Sample dimensions consumed by every bounce (same layout as path_mis)
+#define NORI_WAVEFRONT_BOUNCE_DIMENSIONS 6
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Wavefront path tracer
+ *
+ * Computes the same estimator as \c path_mis, but advances all paths of
+ * an image block together instead of following one path at a time:
+ *
+ * 1. generate: sample a camera ray for every pixel of the block,
+ * 2. extend: find the closest hit of all active rays,
+ * 3. shade: group the hits by material and, one material at a time, add
+ *    the emission, apply Russian roulette, sample an emitter (queueing a
+ *    shadow ray) and sample the BSDF,
+ * 4. shadow: trace all queued shadow rays and add the contributions of
+ *    the unoccluded ones,
+ * 5. accumulate: splat the finished paths into the block.
+ *
+ * Stages 2-4 repeat on the compacted queue of surviving paths. The path
+ * state is stored as a structure of arrays, so that every stage streams
+ * through contiguous memory and only runs one kind of code (traversal,
+ * or a single BSDF) at a time.
+ *
+ * Every bounce uses the same sample dimensions as \c path_mis. With the
+ * samplers that can resume a sample at any dimension (all except
+ * \c independent), both integrators therefore render the same image.
+ */
+class PathWavefront : public Integrator {
+public:
+    PathWavefront(const PropertyList &props) {
+        /* No parameters this time */
+    }
+
+    void preprocess(const Scene *scene) {
+        /* Number the materials in scene order, so that the shading order
+           (and the random numbers of stream-based samplers) is deterministic */
+        m_materialIDs.clear();
+        for (const Shape *shape : scene->getShapes())
+            m_materialIDs.insert(std::make_pair(shape->getBSDF(), (uint32_t) m_materialIDs.size()));
+    }
+
+    bool renderBlock(const Scene *scene, Sampler *sampler, ImageBlock &block,
+            uint32_t sampleIndex) const {
+        /* The path state does not track AOVs: trace one path at a time instead */
+        if (block.getAOVCount() > 0)
+            return false;
+
+        const Camera *camera = scene->getCamera();
+        Point2i offset = block.getOffset();
+        Vector2i size = block.getSize();
+
+        PathStates paths(size.x() * size.y());
+        paths.sampleIndex = sampleIndex;
+        paths.restartSamples = true;
+
+        /* Generate camera rays */
+        for (int y = 0; y < size.y(); ++y) {
+            for (int x = 0; x < size.x(); ++x) {
+                uint32_t i = (uint32_t) (y * size.x() + x);
+                Point2i pixel(x + offset.x(), y + offset.y());
+                sampler->startPixelSample(pixel, sampleIndex);
+
+                Point2f cameraSamples[2];
+                sampler->next2DArray(cameraSamples, 2);
+                Point2f pixelSample = Point2f((float) pixel.x(), (float) pixel.y()) + cameraSamples[0];
+
+                paths.pixel[i] = pixel;
+                paths.pixelSample[i] = pixelSample;
+                paths.weight[i] = camera->sampleRay(paths.ray[i], pixelSample, cameraSamples[1]);
+                paths.queue.push_back(i);
+            }
+        }
+
+        trace(scene, sampler, paths);
+
+        /* Accumulate */
+        for (uint32_t i = 0; i < paths.size; ++i)
+            block.put(paths.pixelSample[i], paths.weight[i] * paths.L[i]);
+
+        return true;
+    }
+
+    Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray) const {
+        /* A wavefront of a single path */
+        PathStates paths(1);
+        paths.ray[0] = ray;
+        paths.queue.push_back(0);
+        trace(scene, sampler, paths);
+        return paths.L[0];
+    }
+
+    std::string toString() const {
+        return "PathWavefront[]";
+    }
+
+protected:
+    /// State of all paths of a wavefront (structure of arrays)
+    struct PathStates {
+        uint32_t size;
+        uint32_t sampleIndex = 0;
+        /// Resume the pixel sample of a path before each bounce?
+        bool restartSamples = false;
+
+        std::vector<Point2i> pixel;
+        std::vector<Point2f> pixelSample;
+        std::vector<Color3f> weight;       ///< Camera importance
+        std::vector<Ray3f> ray;
+        std::vector<Intersection> its;
+        std::vector<uint8_t> hit;
+        std::vector<Color3f> L;            ///< Accumulated radiance
+        std::vector<Color3f> t;            ///< Throughput
+        std::vector<float> w_mat, w_em;    ///< MIS weights of the last BSDF / emitter sample
+        std::vector<Point3f> prevP;        ///< Previous vertex
+        std::vector<Normal3f> prevN;
+        std::vector<float> pdf_matsB;      ///< Solid angle density of the last BSDF sample
+        std::vector<uint8_t> specular;     ///< Was the last BSDF sample discrete?
+
+        /// Indices of the active paths
+        std::vector<uint32_t> queue;
+
+        /// Shadow ray queue (path index, ray and unoccluded contribution)
+        std::vector<uint32_t> shadowPath;
+        std::vector<Ray3f> shadowRay;
+        std::vector<Color3f> shadowL;
+
+        PathStates(uint32_t size)
+            : size(size), pixel(size, Point2i(0, 0)), pixelSample(size, Point2f(0.f)),
+              weight(size, Color3f(1.f)), ray(size), its(size), hit(size, 0),
+              L(size, Color3f(0.f)), t(size, Color3f(1.f)), w_mat(size, 1.f), w_em(size, 1.f),
+              prevP(size), prevN(size), pdf_matsB(size, 0.f), specular(size, 1) {
+            queue.reserve(size);
+            shadowPath.reserve(size);
+            shadowRay.reserve(size);
+            shadowL.reserve(size);
+        }
+    };
+
+    /// Advance all queued paths until they terminate
+    void trace(const Scene *scene, Sampler *sampler, PathStates &paths) const {
+        const Emitter *env = scene->getEnvEmitter();
+        std::vector<uint32_t> hits, sorted, materialCount;
+        hits.reserve(paths.size);
+        sorted.reserve(paths.size);
+
+        for (uint32_t bounce = 0; !paths.queue.empty(); ++bounce) {
+            /* Extend: closest hit of all active rays */
+            for (uint32_t i : paths.queue)
+                paths.hit[i] = scene->rayIntersect(paths.ray[i], paths.its[i]);
+
+            /* Resolve the MIS weights of the BSDF samples of the previous bounce
+               and terminate the paths that escaped the scene */
+            hits.clear();
+            for (uint32_t i : paths.queue) {
+                const Intersection &its = paths.its[i];
+                if (!paths.hit[i]) {
+                    if (env == nullptr)
+                        continue;
+                    EmitterQueryRecord lRec;
+                    lRec.wi = paths.ray[i].d.normalized();
+                    if (bounce > 0 && !paths.specular[i]) {
+                        float pdf_matsE = env->pdf(lRec) * scene->pdfEmitter(paths.prevP[i], paths.prevN[i], env);
+                        updateMaterialWeight(paths, i, pdf_matsE);
+                    }
+                    paths.L[i] += paths.w_mat[i] * env->eval(lRec) * paths.t[i];
+                    continue;
+                }
+                if (its.mesh->isEmitter()) {
+                    if (bounce > 0 && !paths.specular[i]) {
+                        EmitterQueryRecord lRec_R(paths.prevP[i], its.p, its.shFrame.n);
+                        float pdf_matsE = its.mesh->getEmitter()->pdf(lRec_R)
+                            * scene->pdfEmitter(paths.prevP[i], paths.prevN[i], its.mesh->getEmitter());
+                        updateMaterialWeight(paths, i, pdf_matsE);
+                    }
+                    EmitterQueryRecord lRec_mats(paths.ray[i].o, its.p, its.shFrame.n);
+                    paths.L[i] += paths.w_mat[i] * (paths.t[i] * its.mesh->getEmitter()->eval(lRec_mats));
+                }
+                hits.push_back(i);
+            }
+
+            /* Sort the hits by material (counting sort, stable) */
+            materialCount.assign(m_materialIDs.size() + 1, 0);
+            for (uint32_t i : hits)
+                materialCount[materialID(paths.its[i].mesh->getBSDF()) + 1]++;
+            for (size_t m = 1; m < materialCount.size(); ++m)
+                materialCount[m] += materialCount[m - 1];
+            sorted.resize(hits.size());
+            for (uint32_t i : hits)
+                sorted[materialCount[materialID(paths.its[i].mesh->getBSDF())]++] = i;
+
+            /* Shade, one material after the other */
+            paths.queue.clear();
+            paths.shadowPath.clear();
+            paths.shadowRay.clear();
+            paths.shadowL.clear();
+            for (uint32_t i : sorted)
+                shade(scene, sampler, paths, i, bounce);
+
+            /* Shadow: trace the queued shadow rays */
+            for (size_t k = 0; k < paths.shadowPath.size(); ++k) {
+                if (!scene->rayIntersect(paths.shadowRay[k]))
+                    paths.L[paths.shadowPath[k]] += paths.shadowL[k];
+            }
+        }
+    }
+
+    /// Russian roulette, emitter sampling and BSDF sampling at the current vertex of path \c i
+    void shade(const Scene *scene, Sampler *sampler, PathStates &paths, uint32_t i, uint32_t bounce) const {
+        const Intersection &its = paths.its[i];
+        const Ray3f &ray = paths.ray[i];
+        Color3f &t = paths.t[i];
+
+        if (paths.restartSamples)
+            sampler->startPixelSample(paths.pixel[i], paths.sampleIndex,
+                NORI_WAVEFRONT_CAMERA_DIMENSIONS + bounce * NORI_WAVEFRONT_BOUNCE_DIMENSIONS);
+        Point2f u[3];
+        sampler->next2DArray(u, 3);
+
+        // Russian roulette
+        float q = std::min(t.maxCoeff(), 0.99f);
+        if (u[0].x() > q)
+            return;
+        t /= q;
+
+        const BSDF *bsdf = its.mesh->getBSDF();
+
+        // Emitter sampling (the shadow ray is traced in the next stage)
+        float pdf_light = 0.f;
+        const Emitter *emitter = nullptr;
+        if (bsdf->hasSmoothComponent())
+            emitter = scene->sampleEmitter(its.p, its.shFrame.n, u[0].y(), pdf_light);
+        if (emitter != nullptr) {
+            EmitterQueryRecord lRec_ems(its.p);
+            Color3f radiance_ems = emitter->sample(lRec_ems, u[1]) / pdf_light;
+            float pdf_emsE = emitter->pdf(lRec_ems) * pdf_light;
+            float cosTheta_ems = Frame::cosTheta(its.shFrame.toLocal(lRec_ems.wi));
+            BSDFQueryRecord bRec_ems(its.shFrame.toLocal(-ray.d), its.shFrame.toLocal(lRec_ems.wi), ESolidAngle);
+            bRec_ems.uv = its.uv;
+            Color3f BSDF_ems = bsdf->eval(bRec_ems);
+            float pdf_emsB = bsdf->pdf(bRec_ems);
+            if (pdf_emsE + pdf_emsB != 0.0f)
+                paths.w_em[i] = pdf_emsE / (pdf_emsE + pdf_emsB);
+
+            Color3f contribution = paths.w_em[i] * t * radiance_ems * BSDF_ems * std::max(0.f, cosTheta_ems);
+            if (!contribution.isZero()) {
+                paths.shadowPath.push_back(i);
+                paths.shadowRay.push_back(lRec_ems.shadowRay);
+                paths.shadowL.push_back(contribution);
+            }
+        }
+
+        // BSDF sampling: the new ray is intersected in the next extend stage
+        BSDFQueryRecord bRec(its.shFrame.toLocal(-ray.d));
+        bRec.uv = its.uv;
+        Color3f BSDF = bsdf->sample(bRec, u[2]);
+        t *= BSDF;
+
+        paths.specular[i] = bRec.measure == EDiscrete;
+        if (paths.specular[i]) {
+            // Emitter sampling cannot produce a specular direction
+            paths.w_mat[i] = 1.f;
+            paths.w_em[i] = 0.f;
+        }
+        paths.pdf_matsB[i] = bRec.pdf;
+        paths.prevP[i] = its.p;
+        paths.prevN[i] = its.shFrame.n;
+        paths.ray[i] = Ray3f(its.p, its.toWorld(bRec.wo));
+        paths.queue.push_back(i);
+    }
+
+    /// Balance heuristic weight of a BSDF sample that reached an emitter
+    static void updateMaterialWeight(PathStates &paths, uint32_t i, float pdf_matsE) {
+        float pdf_matsB = paths.pdf_matsB[i];
+        if (pdf_matsE + pdf_matsB != 0.f)
+            paths.w_mat[i] = pdf_matsB / (pdf_matsB + pdf_matsE);
+    }
+
+    /// Index of a material in the shading order (unknown materials are shaded last)
+    uint32_t materialID(const BSDF *bsdf) const {
+        auto it = m_materialIDs.find(bsdf);
+        return it != m_materialIDs.end() ? it->second : (uint32_t) m_materialIDs.size();
+    }
+
+private:
+    std::unordered_map<const BSDF *, uint32_t> m_materialIDs;
+};
+
+NORI_REGISTER_CLASS(PathWavefront, "path_wavefront");
+NORI_NAMESPACE_END
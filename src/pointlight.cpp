@@ -1,4 +1,5 @@
 #include <nori/emitter.h>
+#include <nori/lighttree.h>
 
 NORI_NAMESPACE_BEGIN
 
@@ -57,6 +58,15 @@ public:
         return 1.f;
     }
     
+    /// Isotropic emission from a single point
+    virtual bool getLightBounds(LightBounds &bounds) const override {
+        bounds.bbox = BoundingBox3f(m_lightPos);
+        bounds.phi = m_power.getLuminance();
+        bounds.cosTheta_o = -1.0f;
+        bounds.cosTheta_e = 0.0f;
+        return true;
+    }
+
     virtual std::string toString() const {
         return "PointLight[]";
     }
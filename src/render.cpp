@@ -20,16 +20,28 @@
 #include <nori/parser.h>
 #include <nori/scene.h>
 #include <nori/camera.h>
+#include <nori/rfilter.h>
 #include <nori/block.h>
 #include <nori/timer.h>
 #include <nori/bitmap.h>
 #include <nori/sampler.h>
 #include <nori/integrator.h>
 #include <nori/gui.h>
+#include <nori/checkpoint.h>
+#include <nori/arena.h>
+#include <nori/aov.h>
+#include <nori/denoiser.h>
+#include <nori/snapshot.h>
+#include <nori/settings.h>
 #include <tbb/parallel_for.h>
 #include <tbb/blocked_range.h>
+#include <tbb/task_scheduler_init.h>
 #include <filesystem/resolver.h>
-#include <tbb/concurrent_vector.h>
+#include <limits>
+#include <algorithm>
+#include <future>
+#include <sstream>
+#include <cstring>
 
 
 NORI_NAMESPACE_BEGIN
@@ -39,6 +51,7 @@ RenderThread::RenderThread(ImageBlock & block) :
 {
     m_render_status = 0;
     m_progress = 1.f;
+    m_denoisePreview = false;
 }
 RenderThread::~RenderThread() {
     stopRendering();
@@ -62,6 +75,17 @@ void RenderThread::stopRendering() {
     }
 }
 
+void RenderThread::requestStop() {
+    int busy = 1;
+    m_render_status.compare_exchange_strong(busy, 2);
+}
+
+void RenderThread::wait() {
+    if (m_render_thread.joinable())
+        m_render_thread.join();
+    m_render_status = 0;
+}
+
 float RenderThread::getProgress() {
     if(isBusy()) {
         return m_progress;
@@ -69,134 +93,823 @@ float RenderThread::getProgress() {
     else return 1.f;
 }
 
-static void renderBlock(const Scene *scene, Sampler *sampler, ImageBlock &block) {
+bool RenderThread::getDenoisedPreview(Bitmap &bitmap) {
+    tbb::mutex::scoped_lock lock(m_previewMutex);
+    if (!m_denoisePreview || !m_preview)
+        return false;
+    bitmap = *m_preview;
+    return true;
+}
+
+/**
+ * \brief Render one sample of every pixel of a block
+ *
+ * \param aovs
+ *    The AOVs of the planes of the block (see \ref ImageBlock::setAOVCount())
+ */
+static void renderBlock(const Scene *scene, Sampler *sampler, ImageBlock &block, uint32_t sampleIndex,
+                        const std::vector<AOVRecord::EType> &aovs) {
     const Camera *camera = scene->getCamera();
     const Integrator *integrator = scene->getIntegrator();
+    Color3f aovValues[AOVRecord::ETypeCount];
+
+    /* Integrators that render whole blocks at once */
+    if (integrator->renderBlock(scene, sampler, block, sampleIndex))
+        return;
 
     Point2i offset = block.getOffset();
     Vector2i size  = block.getSize();
 
-    /* Clear the block contents */
-    block.clear();
-
     /* For each pixel and pixel sample sample */
     for (int y=0; y<size.y(); ++y) {
         for (int x=0; x<size.x(); ++x) {
-            Point2f pixelSample = Point2f((float) (x + offset.x()), (float) (y + offset.y())) + sampler->next2D();
-            Point2f apertureSample = sampler->next2D();
+            Point2i pixel(x + offset.x(), y + offset.y());
+            sampler->startPixelSample(pixel, sampleIndex);
+
+            /* Pixel and aperture sample */
+            Point2f cameraSamples[2];
+            sampler->next2DArray(cameraSamples, 2);
+
+            Point2f pixelSample = Point2f((float) (x + offset.x()), (float) (y + offset.y())) + cameraSamples[0];
+            Point2f apertureSample = cameraSamples[1];
 
             /* Sample a ray from the camera */
             Ray3f ray;
             Color3f value = camera->sampleRay(ray, pixelSample, apertureSample);
 
             /* Compute the incident radiance */
-            value *= integrator->Li(scene, sampler, ray);
+            if (aovs.empty()) {
+                value *= integrator->LiPixel(scene, sampler, ray, pixel, nullptr);
+                block.put(pixelSample, value);
+                continue;
+            }
+
+            AOVRecord aov;
+            Color3f weight = value;
+            value *= integrator->LiPixel(scene, sampler, ray, pixel, &aov);
+
+            /* Integrators that do not report the first surface cost
+               one more intersection of the camera ray */
+            if (!aov.hasSurface) {
+                Intersection its;
+                aov.setSurface(scene->rayIntersect(ray, its) ? &its : nullptr);
+            }
+            aov.values[AOVRecord::EDirect] *= weight;
+            aov.values[AOVRecord::EIndirect] *= weight;
+            aov.values[AOVRecord::EVariance] = value * value;
+            for (size_t i = 0; i < aovs.size(); ++i)
+                aovValues[i] = aov.values[aovs[i]];
 
             /* Store in the image block */
-            block.put(pixelSample, value);
+            block.put(pixelSample, value, aovValues);
         }
     }
 }
 
-void RenderThread::renderScene(const std::string & filename) {
+/**
+ * \brief Add all tiles to \c image
+ *
+ * Tiles overlap only with their direct neighbours (through the border
+ * of the reconstruction filter). Tiles whose grid coordinates (relative
+ * to \c origin) have the same parity are therefore disjoint, and each
+ * of the four parity classes is merged in parallel without locking.
+ */
+static void mergeTiles(ImageBlock &image, const std::vector<std::unique_ptr<ImageBlock>> &tiles,
+                       const Point2i &origin, int blockSize) {
+    if (2 * image.getBorderSize() >= blockSize) {
+        for (auto &tile : tiles)
+            image.accumulate(*tile);
+        return;
+    }
 
-    filesystem::path path(filename);
+    for (int phase = 0; phase < 4; ++phase) {
+        tbb::parallel_for(size_t(0), tiles.size(), [&](size_t i) {
+            const ImageBlock &tile = *tiles[i];
+            Point2i grid = (tile.getOffset() - origin) / blockSize;
+            int parity = grid.x() % 2 + 2 * (grid.y() % 2);
+            if (parity == phase)
+                image.accumulate(tile);
+        });
+    }
+}
 
-    /* Add the parent directory of the scene file to the
-       file resolver. That way, the XML file can reference
-       resources (OBJ files, textures) using relative paths */
-    getFileResolver()->prepend(path.parent_path());
+/**
+ * \brief Estimate the relative error of a tile from two half buffers
+ *
+ * \c a and \c b accumulate disjoint halves of the samples of the same
+ * tile. The per-pixel error |I - A| / sqrt(I) of the full estimate I
+ * with respect to the half estimate A is averaged over the tile, as in
+ * "A Hierarchical Automatic Stopping Condition for Monte Carlo Global
+ * Illumination" by Dammertz et al. (2010).
+ */
+static float tileError(const ImageBlock &a, const ImageBlock &b) {
+    int border = a.getBorderSize();
+    Vector2i size = a.getSize();
+
+    float error = 0.f;
+    for (int y = 0; y < size.y(); ++y) {
+        for (int x = 0; x < size.x(); ++x) {
+            Color3f ca = a.coeff(y + border, x + border).divideByFilterWeight();
+            Color3f cb = b.coeff(y + border, x + border).divideByFilterWeight();
+            float I = 0.5f * (ca + cb).sum();
+            if (I > 0.f)
+                error += 0.5f * (ca - cb).abs().sum() / std::sqrt(I);
+        }
+    }
+    return error / (size.x() * size.y());
+}
 
-    NoriObject* root = loadFromXML(filename);
+/**
+ * \brief Copy the unnormalized pixels of a block (incl. border) into an array
+ *
+ * \param aovs
+ *    Append the AOV planes of the block?
+ */
+static void saveBlock(const ImageBlock &block, std::vector<float> &data, bool aovs = true) {
+    static_assert(sizeof(Color4f) == 4 * sizeof(float), "Unexpected Color4f layout");
+    size_t planeSize = (size_t) block.size() * 4;
+    int planes = aovs ? 1 + block.getAOVCount() : 1;
+    data.resize(planeSize * planes);
+    std::memcpy(data.data(), block.data(), planeSize * sizeof(float));
+    for (int i = 1; i < planes; ++i)
+        std::memcpy(data.data() + i * planeSize, block.getAOV(i - 1).data(), planeSize * sizeof(float));
+}
 
-    // When the XML root object is a scene, start rendering it ..
-    if (root->getClassType() == NoriObject::EScene) {
-        m_scene = static_cast<Scene *>(root);
+/// Inverse of \ref saveBlock() (incl. the AOV planes)
+static void restoreBlock(const std::vector<float> &data, ImageBlock &block) {
+    size_t planeSize = (size_t) block.size() * 4;
+    if (data.size() != planeSize * (1 + block.getAOVCount()))
+        throw NoriException("The checkpoint does not match the image blocks!");
+    std::memcpy((void *) block.data(), data.data(), planeSize * sizeof(float));
+    for (int i = 0; i < block.getAOVCount(); ++i)
+        std::memcpy((void *) block.getAOV(i).data(), data.data() + (i + 1) * planeSize,
+                    planeSize * sizeof(float));
+}
 
-        const Camera *camera_ = m_scene->getCamera();
-        m_scene->getIntegrator()->preprocess(m_scene);
+/// Turn the second moment of the samples into the variance of the pixel estimates
+static void momentToVariance(Bitmap &moment, const Bitmap &mean, const Bitmap &samples) {
+    for (int y = 0; y < moment.rows(); ++y) {
+        for (int x = 0; x < moment.cols(); ++x) {
+            float n = samples.coeff(y, x).r();
+            const Color3f &m = mean.coeff(y, x);
+            moment.coeffRef(y, x) = n > 1 ? Color3f((moment.coeff(y, x) - m * m).max(0.0f) / (n - 1))
+                                          : Color3f(0.0f);
+        }
+    }
+}
+
+/**
+ * \brief Create the image of the sample count AOV
+ *
+ * Samples are counted per tile. Like the other layers, the image has
+ * the size of the output and is black outside of the crop window,
+ * unless it is cropped to the window.
+ */
+static Bitmap *sampleCountBitmap(const std::vector<std::unique_ptr<ImageBlock>> &tiles,
+                                 const std::vector<uint32_t> &tileSamples, const Vector2i &outputSize,
+                                 const Point2i &windowOffset, const Vector2i &windowSize, bool crop) {
+    Bitmap *result = new Bitmap(crop ? windowSize : outputSize);
+    result->setConstant(Color3f(0.0f));
+    Point2i origin = crop ? windowOffset : Point2i(0, 0);
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        Point2i min = tiles[i]->getOffset().cwiseMax(windowOffset);
+        Point2i max = (tiles[i]->getOffset() + tiles[i]->getSize()).cwiseMin(windowOffset + windowSize);
+        for (int y = min.y(); y < max.y(); ++y)
+            for (int x = min.x(); x < max.x(); ++x)
+                result->coeffRef(y - origin.y(), x - origin.x()) = Color3f((float) tileSamples[i]);
+    }
+    return result;
+}
+
+/// Settings of a rendering that all of its frames share
+struct RenderThread::Job {
+    RenderOptions options;
+    /// Name of the output file (see frameFileName())
+    std::string outputName;
+    int threads = 0;
+    /// Rendered region (the crop window plus the filter margin)
+    Point2i cropOffset;
+    Vector2i cropSize;
+    /// Crop window that is saved
+    Point2i windowOffset;
+    Vector2i windowSize;
+    double loadTime = 0;
+    uint32_t frameCount = 1;
+    /// Settings of the scene description with the overrides of \c options
+    RenderSettings settings;
+    /// AOVs that are rendered per sample (incl. the features of the denoiser)
+    std::vector<AOVRecord::EType> sampleAOVs;
+};
+
+/// Name of the output file of a frame ("name.exr" becomes "name_0007.exr" in a batch)
+static std::string frameFileName(const std::string &name, uint32_t frame, uint32_t frameCount) {
+    if (frameCount <= 1)
+        return name;
+    size_t dot = name.find_last_of('.'), slash = name.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        dot = name.size();
+    return tfm::format("%s_%04i%s", name.substr(0, dot), frame, name.substr(dot));
+}
+
+void RenderThread::renderFrame(const Job &job, uint32_t frame, const RenderCheckpoint *resumed) {
+    const RenderOptions &options = job.options;
+    const RenderSettings &settings = job.settings;
+    const Camera *camera = m_scene->getCamera();
+    std::string outputName = frameFileName(job.outputName, frame, job.frameCount);
+
+    /* Move the camera, and start over with a black image */
+    m_scene->setFrame(frame, job.frameCount, settings.turntable);
+    m_scene->getIntegrator()->beginFrame(m_scene, frame);
+    m_block.lock();
+    m_block.clear();
+    m_block.unlock();
+    {
+        tbb::mutex::scoped_lock lock(m_previewMutex);
+        m_preview.reset();
+    }
+    if (job.frameCount > 1)
+        cout << tfm::format("Frame %i/%i: ", frame + 1, job.frameCount);
+
+    /* The time budget of the first frame includes the time needed to load the scene */
+    double loadTime = frame == 0 ? job.loadTime : 0.0;
+
+    /* Create a block generator (i.e. a work scheduler). A resumed
+       rendering keeps the tiling of its checkpoint */
+    int blockSize = settings.blockSize;
+    if (blockSize == 0)
+        blockSize = resumed ? resumed->blockSize :
+            BlockGenerator::optimalBlockSize(job.cropSize, job.threads, m_block.getBorderSize());
+    BlockGenerator blockGenerator(job.cropOffset, job.cropSize, blockSize, settings.blockOrder);
+
+    cout << "Rendering .. ";
+    cout.flush();
+    Timer timer;
+
+    uint32_t numSamples = (uint32_t) m_scene->getSampler()->getSampleCount();
+    int numBlocks = blockGenerator.getBlockCount();
+
+    /* Samples per pixel rendered by a task before merging its tile */
+    int samplesPerPass = settings.samplesPerPass;
+    uint32_t maxPassSamples = std::max(1u, numSamples / 8);
+
+    /* Adaptive sampling distributes the total budget of the sampler's
+       sample count per pixel over the tiles that have not converged */
+    float threshold = settings.adaptiveThreshold;
+    bool adaptive = threshold > 0.f;
+    uint32_t maxSamples = adaptive ? settings.getMaxSampleCount(numSamples) : numSamples;
+    /* Every tile accumulates into its own block (and uses its own sampler)
+       for the whole rendering, so tasks never have to synchronize. With
+       adaptive sampling, odd samples go to a second block to estimate
+       the error */
+    std::vector<std::unique_ptr<ImageBlock>> tiles(numBlocks), halfTiles;
+    std::vector<std::unique_ptr<Sampler>> samplers(numBlocks);
+    std::vector<int> active;
+    std::vector<uint32_t> tileSamples(numBlocks, 0);
+    uint64_t numPixels = 0;
+    for (int i = 0; i < numBlocks; ++i) {
+        tiles[i].reset(new ImageBlock(Vector2i(blockSize),
+                                      camera->getReconstructionFilter()));
+        tiles[i]->setAOVCount((int) job.sampleAOVs.size());
+        tiles[i]->setSampleCheck(settings.checkSamples);
+        blockGenerator.next(*tiles[i]);
+        tiles[i]->clear();
+        samplers[i] = m_scene->getSampler()->clone();
+        samplers[i]->prepare(*tiles[i]);
+
+        /* A worker of a distributed rendering only renders its share of the tiles */
+        if (i % options.workerCount == options.workerIndex) {
+            active.push_back(i);
+            numPixels += tiles[i]->getSize().prod();
+        }
+    }
+    uint64_t budget = (uint64_t) numSamples * numPixels;
+    uint64_t spent = 0, activePixels = numPixels;
+
+    /* With a time budget, samples are added until the deadline instead */
+    if (settings.timeBudget > 0) {
+        budget = std::numeric_limits<uint64_t>::max();
+        if (!adaptive)
+            maxSamples = std::numeric_limits<uint32_t>::max();
+    }
+
+    if (adaptive) {
+        halfTiles.resize(numBlocks);
+        for (int i = 0; i < numBlocks; ++i) {
+            halfTiles[i].reset(new ImageBlock(Vector2i(blockSize),
+                                              camera->getReconstructionFilter()));
+            halfTiles[i]->setAOVCount((int) job.sampleAOVs.size());
+            halfTiles[i]->setSampleCheck(settings.checkSamples);
+            halfTiles[i]->setOffset(tiles[i]->getOffset());
+            halfTiles[i]->setSize(tiles[i]->getSize());
+            halfTiles[i]->clear();
+        }
+    }
+
+    /* Error estimates are unreliable until both halves have a few samples */
+    const uint32_t minAdaptiveSamples = 8;
+
+    /* Measured cost of one pixel sample during the last pass (in seconds) */
+    double costPerSample = 0;
+
+    /* Configuration stored in checkpoints */
+    RenderCheckpoint config;
+    config.outputSize = camera->getOutputSize();
+    config.cropOffset = job.cropOffset;
+    config.cropSize = job.cropSize;
+    config.blockSize = blockSize;
+    config.blockOrder = (int) settings.blockOrder;
+    config.borderSize = m_block.getBorderSize();
+    config.sampleCount = numSamples;
+    config.adaptive = adaptive;
+    config.sampleOffset = options.sampleOffset;
+    config.seedOffset = options.seedOffset;
+    config.workerIndex = options.workerIndex;
+    config.workerCount = options.workerCount;
+    config.frame = frame;
+
+    uint32_t k = 0, pass = 0, passSamples = 1;
+
+    /* Continue where a previous process left off */
+    if (resumed) {
+        const RenderCheckpoint &checkpoint = *resumed;
+        if (!checkpoint.isCompatible(config) || checkpoint.tiles.size() != (size_t) numBlocks)
+            throw NoriException("The checkpoint \"%s\" belongs to a different rendering!",
+                                options.checkpointName);
+
+        active.clear();
+        activePixels = 0;
+        for (int i = 0; i < numBlocks; ++i) {
+            const RenderCheckpoint::Tile &tile = checkpoint.tiles[i];
+            tileSamples[i] = tile.samples;
+            restoreBlock(tile.data, *tiles[i]);
+            if (adaptive)
+                restoreBlock(tile.halfData, *halfTiles[i]);
+            std::istringstream is(tile.sampler);
+            samplers[i]->unserialize(is);
+            if (tile.active) {
+                active.push_back(i);
+                activePixels += tiles[i]->getSize().prod();
+            }
+        }
+        k = checkpoint.samples;
+        pass = checkpoint.pass;
+        passSamples = checkpoint.passSamples;
+        spent = checkpoint.spent;
+        /* The time budget also covers the time spent before the checkpoint */
+        loadTime += checkpoint.elapsed;
+
+        m_block.lock();
+        mergeTiles(m_block, tiles, job.cropOffset, blockSize);
+        mergeTiles(m_block, halfTiles, job.cropOffset, blockSize);
+        m_block.unlock();
+
+        cout << "resuming from \"" << options.checkpointName << "\" at pass "
+             << pass << " .. ";
+        cout.flush();
+    }
+
+    /* Normalized image of an AOV within a region of the output (the
+       caller locks the image block) */
+    auto aovBitmap = [&](AOVRecord::EType type, const Point2i &offset, const Vector2i &size,
+                         bool crop) -> Bitmap * {
+        if (type == AOVRecord::ESampleCount)
+            return sampleCountBitmap(tiles, tileSamples, m_block.getSize(), offset, size, crop);
+        int index = (int) (std::find(job.sampleAOVs.begin(), job.sampleAOVs.end(), type) -
+                           job.sampleAOVs.begin());
+        Bitmap *result = m_block.aovToBitmap(index, offset, size, crop);
+        if (type == AOVRecord::EVariance) {
+            std::unique_ptr<Bitmap> mean(m_block.toBitmap(offset, size, crop));
+            std::unique_ptr<Bitmap> samples(sampleCountBitmap(tiles, tileSamples, m_block.getSize(),
+                                                              offset, size, crop));
+            momentToVariance(*result, *mean, *samples);
+        }
+        return result;
+    };
+
+    /* Denoise an image of a region of the output, guided by the feature AOVs */
+    Denoiser denoiser(settings.denoiseIterations);
+    auto denoise = [&](const Bitmap &image, const Point2i &offset, const Vector2i &size,
+                       bool crop) -> Bitmap * {
+        m_block.lock();
+        std::unique_ptr<Bitmap> variance(aovBitmap(AOVRecord::EVariance, offset, size, crop));
+        std::unique_ptr<Bitmap> albedo(aovBitmap(AOVRecord::EAlbedo, offset, size, crop));
+        std::unique_ptr<Bitmap> normal(aovBitmap(AOVRecord::ENormal, offset, size, crop));
+        std::unique_ptr<Bitmap> depth(aovBitmap(AOVRecord::EDepth, offset, size, crop));
+        m_block.unlock();
+        return denoiser.denoise(image, *variance, *albedo, *normal, *depth);
+    };
+
+    /* Checkpoints are written by a background task, so that the render
+       loop only pays for copying the tiles */
+    std::future<void> checkpointWriter;
+    Timer checkpointTimer;
+
+    /* Snapshots of the image in progress, also written in the background */
+    std::unique_ptr<SnapshotWriter> snapshotWriter;
+    if (!options.snapshotName.empty())
+        snapshotWriter.reset(new SnapshotWriter());
+    std::string snapshotName = frameFileName(options.snapshotName, frame, job.frameCount);
+    Timer snapshotTimer;
+    uint32_t snapshotPass = pass;
+
+    for (; k < maxSamples && spent < budget && !active.empty();
+         k += passSamples, ++pass) {
+        double elapsed = loadTime + timer.elapsed() * 1e-3;
+        m_progress = settings.timeBudget > 0 ? std::min(1.f, (float) (elapsed / settings.timeBudget))
+                                    : spent/float(budget);
+        if(m_render_status == 2)
+            break;
+
+        if (samplesPerPass > 0)
+            passSamples = (uint32_t) samplesPerPass;
+        else if (pass > 1) /* Adaptive: 1, 1, 2, 4, .. */
+            passSamples = std::min(2 * passSamples, maxPassSamples);
+        passSamples = std::min(passSamples, maxSamples - k);
+        passSamples = (uint32_t) std::min<uint64_t>(passSamples,
+            1 + (budget - spent - 1) / activePixels);
+
+        /* Only start passes that are expected to finish before the deadline.
+           The last pass is the best predictor, since the remaining tiles of
+           adaptive sampling are not representative of the whole image */
+        if (settings.timeBudget > 0 && costPerSample > 0) {
+            double affordable = (settings.timeBudget - elapsed) / (costPerSample * activePixels);
+            if (affordable < 1)
+                break;
+            passSamples = (uint32_t) std::min<double>(passSamples, affordable);
+        }
+
+        m_scene->getIntegrator()->beginPass(pass);
+        double passStart = timer.elapsed() * 1e-3;
+
+        /* Every worker repeatedly takes the next active tile (in the order of
+           the block generator) from an atomic counter. An interruption
+           stops the tiles partway, so each one records what it rendered */
+        std::atomic<int> nextTile(0);
+        std::vector<uint32_t> rendered(active.size(), 0);
+
+        auto map = [&](int) {
+            for (int j; (j = nextTile++) < (int) active.size(); ) {
+                int i = active[j];
+                // Render all contained pixels, several times if requested
+                uint32_t s = 0;
+                for (; s < passSamples && m_render_status != 2; ++s) {
+                    bool odd = adaptive && (k + s) % 2 == 1;
+                    renderBlock(m_scene, samplers[i].get(), odd ? *halfTiles[i] : *tiles[i],
+                                options.sampleOffset + tileSamples[i] + s, job.sampleAOVs);
+                }
+                rendered[j] = s;
+            }
+        };
+
+        /// Uncomment the following line for single threaded rendering
+        //map(0);
 
-        /* Allocate memory for the entire output image and clear it */
-        m_block.init(camera_->getOutputSize(), camera_->getReconstructionFilter());
+        /// Default: parallel rendering
+        tbb::parallel_for(0, job.threads, map);
+        for (size_t j = 0; j < active.size(); ++j) {
+            int i = active[j];
+            tileSamples[i] += rendered[j];
+            spent += (uint64_t) rendered[j] * tiles[i]->getSize().prod();
+        }
+
+        // Publish the progress: sum the tiles into the "big" block that represents the entire image
+        m_block.lock();
         m_block.clear();
+        mergeTiles(m_block, tiles, job.cropOffset, blockSize);
+        mergeTiles(m_block, halfTiles, job.cropOffset, blockSize);
+        m_block.unlock();
+        costPerSample = (timer.elapsed() * 1e-3 - passStart) / (passSamples * activePixels);
+
+        /* Hand a snapshot of the progress to the writer if one is due */
+        if (snapshotWriter && m_render_status != 2 &&
+            ((options.snapshotPasses > 0 && pass + 1 - snapshotPass >= (uint32_t) options.snapshotPasses) ||
+             (options.snapshotInterval > 0 && snapshotTimer.elapsed() >= options.snapshotInterval * 1000))) {
+            m_block.lock();
+            snapshotWriter->submit(m_block, job.windowOffset, job.windowSize, settings.cropOutput, snapshotName);
+            m_block.unlock();
+            snapshotTimer.reset();
+            snapshotPass = pass + 1;
+        }
 
-        /* Determine the filename of the output bitmap */
-        std::string outputName = filename;
-        size_t lastdot = outputName.find_last_of(".");
-        if (lastdot != std::string::npos)
-            outputName.erase(lastdot, std::string::npos);
-        outputName += ".exr";
+        /* Denoised preview of the progress (for display) */
+        if (settings.denoise && m_denoisePreview && m_render_status != 2) {
+            m_block.lock();
+            std::unique_ptr<Bitmap> image(m_block.toBitmap(job.windowOffset, job.windowSize, false));
+            m_block.unlock();
+            std::unique_ptr<Bitmap> preview(denoise(*image, job.windowOffset, job.windowSize, false));
+            tbb::mutex::scoped_lock lock(m_previewMutex);
+            m_preview = std::move(preview);
+        }
 
-        /* Do the following in parallel and asynchronously */
-        m_render_status = 1;
-        m_render_thread = std::thread([this,outputName] {
-            const Camera *camera = m_scene->getCamera();
-            Vector2i outputSize = camera->getOutputSize();
+        /* Retire the tiles that reached the target error */
+        if (adaptive && k + passSamples >= minAdaptiveSamples) {
+            std::vector<float> errors(active.size());
+            tbb::parallel_for(size_t(0), active.size(), [&](size_t j) {
+                errors[j] = tileError(*tiles[active[j]], *halfTiles[active[j]]);
+            });
+            size_t remaining = 0;
+            for (size_t j = 0; j < active.size(); ++j) {
+                if (errors[j] < threshold)
+                    activePixels -= tiles[active[j]]->getSize().prod();
+                else
+                    active[remaining++] = active[j];
+            }
+            active.resize(remaining);
+        }
+
+        /* Take a checkpoint if it is due and the previous one has been written
+           (an interrupted pass leaves the tiles in an inconsistent state) */
+        bool writerIdle = !checkpointWriter.valid() ||
+            checkpointWriter.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        if (!options.checkpointName.empty() && m_render_status != 2 && writerIdle &&
+            checkpointTimer.elapsed() >= options.checkpointInterval * 1000) {
+            std::shared_ptr<RenderCheckpoint> checkpoint = std::make_shared<RenderCheckpoint>(config);
+            checkpoint->samples = k + passSamples;
+            checkpoint->pass = pass + 1;
+            checkpoint->passSamples = passSamples;
+            checkpoint->spent = spent;
+            checkpoint->elapsed = loadTime + timer.elapsed() * 1e-3;
+            checkpoint->tiles.resize(numBlocks);
+            for (int i = 0; i < numBlocks; ++i) {
+                RenderCheckpoint::Tile &tile = checkpoint->tiles[i];
+                tile.samples = tileSamples[i];
+                tile.active = false;
+                saveBlock(*tiles[i], tile.data);
+                if (adaptive)
+                    saveBlock(*halfTiles[i], tile.halfData);
+                std::ostringstream os;
+                samplers[i]->serialize(os);
+                tile.sampler = os.str();
+            }
+            for (int i : active)
+                checkpoint->tiles[i].active = true;
+
+            std::string checkpointName = options.checkpointName;
+            checkpointWriter = std::async(std::launch::async, [checkpoint, checkpointName] {
+                try {
+                    checkpoint->save(checkpointName);
+                } catch (const std::exception &e) {
+                    cerr << "Warning: " << e.what() << endl;
+                }
+            });
+            checkpointTimer.reset();
+        }
+    }
+
+    if (checkpointWriter.valid())
+        checkpointWriter.wait();
+    if (snapshotWriter) {
+        snapshotWriter->stop();
+        m_statistics.snapshots += snapshotWriter->getWrittenCount();
+    }
 
-            /* Create a block generator (i.e. a work scheduler) */
-            BlockGenerator blockGenerator(outputSize, NORI_BLOCK_SIZE);
+    cout << "done. (took " << timer.elapsedString() << ")" << endl;
+    m_statistics.renderTime += timer.elapsed() * 1e-3;
+    m_statistics.frameTimes.push_back(timer.elapsed() * 1e-3);
+    m_statistics.outputName = outputName;
+    m_statistics.tiles.clear();
+    m_statistics.samplesPerPixel = numPixels > 0 ? spent / (float) numPixels : 0.f;
+    uint32_t minSamples = std::numeric_limits<uint32_t>::max(), maxTileSamples = 0;
+    uint64_t invalidSamples = 0;
+    for (int i = options.workerIndex; i < numBlocks; i += options.workerCount) {
+        m_statistics.tiles.push_back({ tiles[i]->getOffset(), tiles[i]->getSize(), tileSamples[i] });
+        minSamples = std::min(minSamples, tileSamples[i]);
+        maxTileSamples = std::max(maxTileSamples, tileSamples[i]);
+        invalidSamples += tiles[i]->getInvalidSampleCount();
+        if (adaptive)
+            invalidSamples += halfTiles[i]->getInvalidSampleCount();
+    }
+    m_statistics.invalidSamples += invalidSamples;
+    if (invalidSamples > 0)
+        cerr << tfm::format("Warning: the integrator computed %i invalid (negative, NaN or "
+                            "infinite) radiance values, which were discarded", invalidSamples) << endl;
+    if ((adaptive || settings.timeBudget > 0) && !m_statistics.tiles.empty())
+        cout << tfm::format("Rendered %.1f samples per pixel on average "
+                            "(%i to %i per tile)", m_statistics.samplesPerPixel,
+                            minSamples, maxTileSamples) << endl;
+
+    if (!options.partialName.empty()) {
+        /* Keep the unnormalized accumulation, which nori-merge
+           combines with the partials of the other workers */
+        RenderPartial partial;
+        partial.outputSize = camera->getOutputSize();
+        partial.borderSize = m_block.getBorderSize();
+        partial.sampleOffset = options.sampleOffset;
+        partial.sampleCount = numSamples;
+        partial.seedOffset = options.seedOffset;
+        partial.workerIndex = options.workerIndex;
+        partial.workerCount = options.workerCount;
+        m_block.lock();
+        saveBlock(m_block, partial.data, false);
+        m_block.unlock();
+        partial.save(outputName);
+    } else {
+        /* Now turn the rendered region into a properly normalized
+           bitmap (of the full size, or of the region only) */
+        m_block.lock();
+        std::unique_ptr<Bitmap> bitmap(m_block.toBitmap(job.windowOffset, job.windowSize, settings.cropOutput));
+
+        /* The AOVs become additional layers of the same file */
+        std::vector<std::unique_ptr<Bitmap>> aovBitmaps;
+        std::vector<Bitmap::Layer> layers;
+        for (AOVRecord::EType type : settings.aovs) {
+            aovBitmaps.emplace_back(aovBitmap(type, job.windowOffset, job.windowSize, settings.cropOutput));
+            layers.push_back({ AOVRecord::typeName(type), AOVRecord::channelNames(type),
+                               aovBitmaps.back().get() });
+        }
+        m_block.unlock();
 
-            cout << "Rendering .. ";
+        /* The denoised image replaces the noisy one, which is kept as a layer */
+        if (settings.denoise) {
+            cout << "Denoising .. ";
             cout.flush();
-            Timer timer;
+            Timer denoiseTimer;
+            std::unique_ptr<Bitmap> noisy = std::move(bitmap);
+            bitmap.reset(denoise(*noisy, job.windowOffset, job.windowSize, settings.cropOutput));
+            aovBitmaps.push_back(std::move(noisy));
+            layers.push_back({ "noisy", "RGB", aovBitmaps.back().get() });
+            m_statistics.denoiseTime += denoiseTimer.elapsed() * 1e-3;
+            cout << "done. (took " << denoiseTimer.elapsedString() << ")" << endl;
+        }
 
-            auto numSamples = m_scene->getSampler()->getSampleCount();
-            auto numBlocks = blockGenerator.getBlockCount();
+        /* Save using the OpenEXR format */
+        bitmap->save(outputName, layers);
+    }
+}
 
-            tbb::concurrent_vector< std::unique_ptr<Sampler> > samplers;
-            samplers.resize(numBlocks);
+void RenderThread::renderScene(const std::string & filename, const RenderOptions &options) {
 
-            for (uint32_t k = 0; k < numSamples ; ++k) {
-                m_progress = k/float(numSamples);
-                if(m_render_status == 2)
-                    break;
+    filesystem::path path(filename);
 
-                tbb::blocked_range<int> range(0, numBlocks);
+    /* Add the parent directory of the scene file to the
+       file resolver. That way, the XML file can reference
+       resources (OBJ files, textures) using relative paths */
+    getFileResolver()->prepend(path.parent_path());
 
-                auto map = [&](const tbb::blocked_range<int> &range) {
-                    // Allocate memory for a small image block to be rendered by the current thread
-                    ImageBlock block(Vector2i(NORI_BLOCK_SIZE),
-                                     camera->getReconstructionFilter());
+    Timer loadTimer;
 
-                    for (int i = range.begin(); i < range.end(); ++i) {
-                        // Request an image block from the block generator
-                        blockGenerator.next(block);
+    NoriObject* root = loadFromXML(filename);
+
+    // When the XML root object is a scene, start rendering it ..
+    if (root->getClassType() == NoriObject::EScene) {
+        m_scene = static_cast<Scene *>(root);
 
-                        // Get block id to continue using the same sampler
-                        auto blockId = block.getBlockId();
-                        if(k == 0) { // Initialize the sampler for the first sample
-                            std::unique_ptr<Sampler> sampler(m_scene->getSampler()->clone());
-                            sampler->prepare(block);
-                            samplers.at(blockId) = std::move(sampler);
-                        }
+        /* Apply the overrides before anything depends on them */
+        if (options.sampleCount > 0)
+            m_scene->getSampler()->setSampleCount((size_t) options.sampleCount);
+        m_scene->getSampler()->setSeedOffset(options.seedOffset);
+        if ((options.resolution.array() > 0).all())
+            m_scene->getCamera()->setOutputSize(options.resolution);
 
-                        // Render all contained pixels
-                        renderBlock(m_scene, samplers.at(blockId).get(), block);
+        /* The render settings of the scene description, with the overrides
+           of the command line */
+        RenderSettings settings(m_scene->getProperties());
+        settings.applyOverrides(options);
+        cout << "Render settings: " << settings.toString() << endl;
+        cout << endl;
 
-                        // The image block has been processed. Now add it to the "big" block that represents the entire image
-                        m_block.put(block);
-                    }
-                };
+        const Camera *camera_ = m_scene->getCamera();
+        Vector2i outputSize_ = camera_->getOutputSize();
+
+        /* Restrict rendering to the crop window, if any */
+        Point2i windowOffset(0, 0), cropOffset(0, 0);
+        Vector2i windowSize = outputSize_, cropSize = outputSize_;
+        Point2i requestedOffset = settings.cropOffset;
+        Vector2i requestedSize = settings.cropSize;
+        if ((requestedSize.array() > 0).all()) {
+            windowOffset = requestedOffset.cwiseMax(Point2i(0, 0));
+            windowSize = (requestedOffset + requestedSize).cwiseMin(outputSize_) - windowOffset;
+            if ((windowSize.array() <= 0).any())
+                throw NoriException("The crop window does not overlap the image!");
+
+            /* The samples of the pixels within the filter radius around the
+               window contribute to it, so they are rendered as well. This way,
+               the window matches the same region of a full rendering */
+            const ReconstructionFilter *filter = camera_->getReconstructionFilter();
+            int margin = filter ? (int) std::ceil(filter->getRadius() - 0.5f) : 0;
+            cropOffset = (windowOffset - Vector2i(margin, margin)).cwiseMax(Point2i(0, 0));
+            cropSize = (windowOffset + windowSize + Vector2i(margin, margin)).cwiseMin(outputSize_) - cropOffset;
+        }
 
-                /// Uncomment the following line for single threaded rendering
-                //map(range);
+        /* Each sample of such an integrator builds on the pass before it */
+        if (m_scene->getIntegrator()->reusesPreviousPass() && settings.samplesPerPass != 1) {
+            cerr << "Warning: the integrator reuses the previous pass, rendering "
+                    "one sample per pass" << endl;
+            settings.samplesPerPass = 1;
+        }
 
-                /// Default: parallel rendering
-                tbb::parallel_for(range, map);
+        /* Frames of a batch rendering */
+        uint32_t frameCount = settings.getFrameCount(m_scene->getCameraCount());
 
-                blockGenerator.reset();
+        /* Auxiliary images. Apart from the sample count, every AOV has a
+           plane in the image blocks */
+        std::vector<AOVRecord::EType> sampleAOVs;
+        for (AOVRecord::EType type : settings.aovs) {
+            if (type != AOVRecord::ESampleCount)
+                sampleAOVs.push_back(type);
+        }
+        if (settings.denoise && !options.partialName.empty()) {
+            cerr << "Warning: partial renderings are not denoised" << endl;
+            settings.denoise = false;
+        }
+        if (settings.denoise) {
+            for (AOVRecord::EType type : { AOVRecord::EAlbedo, AOVRecord::ENormal,
+                                           AOVRecord::EDepth, AOVRecord::EVariance }) {
+                if (std::find(sampleAOVs.begin(), sampleAOVs.end(), type) == sampleAOVs.end())
+                    sampleAOVs.push_back(type);
             }
+        }
 
-            cout << "done. (took " << timer.elapsedString() << ")" << endl;
+        /* Everything that runs in parallel is confined to an arena with the
+           requested threads */
+        m_arena.reset(new ThreadArena(settings.threads, settings.numaNode, settings.pinThreads));
+        int threads = m_arena->getThreadCount();
+        tbb::task_scheduler_init init(threads);
+
+        m_arena->execute([&] {
+            m_scene->buildBVH();
+            m_scene->getIntegrator()->preprocess(m_scene);
+
+            /* Allocate memory for the entire output image and clear it. The
+               pages are first touched by a thread of the arena, i.e. on its
+               NUMA node */
+            m_block.init(outputSize_, camera_->getReconstructionFilter());
+            m_block.setAOVCount((int) sampleAOVs.size());
+            m_block.clear();
+        });
 
-            /* Now turn the rendered image block into
-               a properly normalized bitmap */
-            m_block.lock();
-            std::unique_ptr<Bitmap> bitmap(m_block.toBitmap());
-            m_block.unlock();
+        /* Determine the filename of the output bitmap */
+        std::string outputName = options.outputName;
+        if (outputName.empty()) {
+            outputName = filename;
+            size_t lastdot = outputName.find_last_of(".");
+            if (lastdot != std::string::npos)
+                outputName.erase(lastdot, std::string::npos);
+            outputName += ".exr";
+        }
+        if (!options.partialName.empty())
+            outputName = options.partialName;
+
+        m_statistics = RenderStatistics();
+        m_statistics.outputName = frameFileName(outputName, 0, frameCount);
+        m_statistics.size = settings.cropOutput ? windowSize : outputSize_;
+        m_statistics.threads = threads;
+        m_statistics.frames = (int) frameCount;
+        m_statistics.loadTime = loadTimer.elapsed() * 1e-3;
+
+        Job job;
+        job.options = options;
+        job.outputName = outputName;
+        job.threads = threads;
+        job.cropOffset = cropOffset;
+        job.cropSize = cropSize;
+        job.windowOffset = windowOffset;
+        job.windowSize = windowSize;
+        job.loadTime = m_statistics.loadTime;
+        job.frameCount = frameCount;
+        job.settings = settings;
+        job.sampleAOVs = sampleAOVs;
 
-            /* Save using the OpenEXR format */
-            bitmap->save(outputName);
+        /* Do the following in parallel and asynchronously */
+        m_render_status = 1;
+
+        m_render_thread = std::thread([this, job] {
+            /* Make sure that TBB's worker pool is large enough for the arena */
+            tbb::task_scheduler_init init(job.threads);
+            try {
+                /* All parallel work of the render loop runs in the arena */
+                m_arena->execute([&] {
+                    const RenderOptions &options = job.options;
+
+                    /* A resumed rendering continues with the frame of its checkpoint */
+                    std::unique_ptr<RenderCheckpoint> resumed;
+                    if (options.resume && filesystem::path(options.checkpointName).exists()) {
+                        resumed.reset(new RenderCheckpoint());
+                        resumed->load(options.checkpointName);
+                        if (resumed->frame >= job.frameCount)
+                            throw NoriException("The checkpoint \"%s\" belongs to a different rendering!",
+                                                options.checkpointName);
+                    }
+
+                    /* The scene data (BVH, emitter tables, preprocessed integrator
+                       state) is shared by all frames */
+                    uint32_t firstFrame = resumed ? resumed->frame : 0;
+                    m_statistics.success = false;
+                    for (uint32_t frame = firstFrame; frame < job.frameCount && m_render_status != 2; ++frame)
+                        renderFrame(job, frame, frame == firstFrame ? resumed.get() : nullptr);
+
+                    /* Only a rendering that finished every frame succeeded. A
+                       finished rendering does not need its checkpoint anymore */
+                    if (m_render_status != 2) {
+                        m_statistics.success = true;
+                        if (!options.checkpointName.empty())
+                            std::remove(options.checkpointName.c_str());
+                    }
+                });
+            } catch (const std::exception &e) {
+                cerr << "Fatal error: " << e.what() << endl;
+                m_statistics.success = false;
+            }
 
             delete m_scene;
             m_scene = nullptr;
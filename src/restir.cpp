@@ -0,0 +1,306 @@
+#include <nori/integrator.h>
+#include <nori/scene.h>
+#include <nori/bsdf.h>
+#include <nori/sampler.h>
+#include <nori/camera.h>
+#include <nori/warp.h>
+#include <nori/aov.h>
+#include <atomic>
+#include <memory>
+
+/// Upper bound on the number of spatial neighbours per pixel
+#define NORI_RESTIR_MAX_NEIGHBORS 16
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Direct illumination with reservoir-based spatiotemporal
+ * importance resampling
+ *
+ * Every pixel first resamples one light sample out of a set of candidates
+ * drawn from the scene's light sampler, using the unshadowed contribution
+ * as target function. The resulting reservoir is then combined with the
+ * reservoirs that the same pixel and a few neighbouring pixels produced
+ * during the previous pass. Only the final sample is traced for
+ * visibility, so each pixel sample costs a single shadow ray.
+ *
+ * A light sample is identified by its emitter and the random numbers
+ * passed to \ref Emitter::sample(). This space does not depend on the
+ * shading point, so samples can be moved between pixels without a change
+ * of measure. Reservoirs are combined with the 1/Z normalization of
+ * "Spatiotemporal reservoir resampling for real-time ray tracing with
+ * dynamic direct lighting" by Bitterli et al. (2020), which keeps the
+ * estimator unbiased.
+ *
+ * The reservoirs of the current pass are written from the const
+ * \ref LiPixel(), which is only safe because every pixel is rendered
+ * by exactly one task and once per pass (see \ref reusesPreviousPass()).
+ * Each pixel stamps the pass that wrote it, and a second write in the
+ * same pass throws instead of racing.
+ */
+class ReSTIRIntegrator : public Integrator {
+public:
+    ReSTIRIntegrator(const PropertyList &props) {
+        m_candidates = props.getInteger("candidates", 32);
+        m_spatialSamples = props.getInteger("spatialSamples", 3);
+        m_spatialRadius = props.getFloat("spatialRadius", 10.f);
+        m_temporalReuse = props.getBoolean("temporalReuse", true);
+        m_historyLimit = props.getInteger("historyLimit", 20);
+
+        if (m_candidates < 1)
+            throw NoriException("ReSTIR: at least one candidate is required!");
+        if (m_spatialSamples < 0 || m_spatialSamples > NORI_RESTIR_MAX_NEIGHBORS)
+            throw NoriException("ReSTIR: 'spatialSamples' must be in [0, %i]!", NORI_RESTIR_MAX_NEIGHBORS);
+    }
+
+    void beginFrame(const Scene *scene, uint32_t frame) {
+        /* The reservoirs of the previous frame belong to another view */
+        m_size = scene->getCamera()->getOutputSize();
+        size_t pixels = (size_t) m_size.x() * m_size.y();
+        m_current.assign(pixels, PixelState());
+        m_previous.assign(pixels, PixelState());
+        m_written.reset(new std::atomic<uint32_t>[pixels]);
+        for (size_t i = 0; i < pixels; ++i)
+            m_written[i].store(0, std::memory_order_relaxed);
+    }
+
+    void beginPass(uint32_t pass) {
+        /* The reservoirs of the pass that just finished become read-only */
+        std::swap(m_current, m_previous);
+        ++m_generation;
+    }
+
+    bool reusesPreviousPass() const { return true; }
+
+    Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray) const {
+        /* Without a pixel, there is nothing to reuse */
+        return LiPixel(scene, sampler, ray, Point2i(-1, -1), nullptr);
+    }
+
+    Color3f LiPixel(const Scene *scene, Sampler *sampler, const Ray3f &ray, const Point2i &pixel,
+                    AOVRecord *aov) const {
+        bool reuse = pixel.x() >= 0 && pixel.y() >= 0 &&
+            pixel.x() < m_size.x() && pixel.y() < m_size.y();
+        PixelState *state = nullptr;
+        if (reuse) {
+            size_t index = (size_t) pixel.y() * m_size.x() + pixel.x();
+            if (m_written[index].exchange(m_generation, std::memory_order_relaxed) == m_generation)
+                throw NoriException("ReSTIR: pixel %s was rendered twice in the same pass! "
+                                    "The reservoirs require one sample per pixel and pass.",
+                                    pixel.toString());
+            state = &m_current[index];
+            *state = PixelState();
+        }
+
+        /* Find the surface that is visible in the requested direction */
+        Intersection its;
+        bool hit = scene->rayIntersect(ray, its);
+        if (aov) {
+            /* All light is direct illumination of the first surface */
+            aov->setSurface(hit ? &its : nullptr);
+            aov->setSplit(Color3f(0.0f), Color3f(0.0f));
+        }
+        if (!hit)
+            return Color3f(0.0f);
+
+        Surface surface;
+        surface.p = its.p;
+        surface.t = its.t;
+        surface.uv = its.uv;
+        surface.shFrame = its.shFrame;
+        surface.wo = its.shFrame.toLocal(-ray.d);
+        surface.mesh = its.mesh;
+
+        Color3f Le(0.0f);
+        if (its.mesh->isEmitter()) {
+            EmitterQueryRecord lRecE(ray.o, its.p, its.shFrame.n);
+            Le = its.mesh->getEmitter()->eval(lRecE);
+        }
+
+        /* Purely specular surfaces cannot be lit by emitter sampling */
+        if (!its.mesh->getBSDF()->hasSmoothComponent()) {
+            if (aov)
+                aov->setSplit(Le, Color3f(0.0f));
+            return Le;
+        }
+
+        /* Resample one light sample out of the candidates */
+        Reservoir candidates;
+        for (int i = 0; i < m_candidates; ++i) {
+            float pdf_light = 0.f;
+            const Emitter *emitter = scene->sampleEmitter(surface.p, surface.shFrame.n, sampler->next1D(), pdf_light);
+            Point2f u = sampler->next2D();
+            float rnd = sampler->next1D();
+            if (emitter == nullptr) {
+                candidates.M += 1;
+                continue;
+            }
+            float target = contribution(surface, emitter, u).getLuminance();
+            candidates.update(emitter, u, target / pdf_light, 1, rnd);
+        }
+
+        /* Combine with the reservoirs of the previous pass */
+        const PixelState *reused[NORI_RESTIR_MAX_NEIGHBORS + 1];
+        int reusedCount = 0;
+        if (reuse) {
+            if (m_temporalReuse) {
+                const PixelState &q = m_previous[pixel.y() * m_size.x() + pixel.x()];
+                if (isSimilar(surface, q))
+                    reused[reusedCount++] = &q;
+            }
+            for (int i = 0; i < m_spatialSamples; ++i) {
+                Point2f offset = Warp::squareToUniformDisk(sampler->next2D()) * m_spatialRadius;
+                Point2i qPixel(pixel.x() + (int) std::round(offset.x()),
+                               pixel.y() + (int) std::round(offset.y()));
+                if (qPixel == pixel || qPixel.x() < 0 || qPixel.y() < 0 ||
+                    qPixel.x() >= m_size.x() || qPixel.y() >= m_size.y())
+                    continue;
+                const PixelState &q = m_previous[qPixel.y() * m_size.x() + qPixel.x()];
+                if (isSimilar(surface, q))
+                    reused[reusedCount++] = &q;
+            }
+        }
+
+        Reservoir combined;
+        combined.update(candidates.emitter, candidates.u, candidates.wSum, candidates.M, sampler->next1D());
+        uint32_t historyLimit = (uint32_t) (m_historyLimit * m_candidates);
+        for (int i = 0; i < reusedCount; ++i) {
+            const Reservoir &r = reused[i]->reservoir;
+            uint32_t M = std::min(r.M, historyLimit);
+            float rnd = sampler->next1D();
+            if (r.emitter == nullptr) {
+                combined.M += M;
+                continue;
+            }
+            float target = contribution(surface, r.emitter, r.u).getLuminance();
+            combined.update(r.emitter, r.u, target * r.W * M, M, rnd);
+        }
+
+        /* Shade the selected sample, which requires the only shadow ray */
+        Color3f L_ems(0.0f);
+        if (combined.emitter != nullptr) {
+            EmitterQueryRecord lRec;
+            Color3f value = contribution(surface, combined.emitter, combined.u, &lRec);
+            float target = value.getLuminance();
+
+            /* Normalize by the candidates of all reservoirs that could have produced this sample */
+            uint32_t Z = candidates.M;
+            for (int i = 0; i < reusedCount; ++i) {
+                const PixelState &q = *reused[i];
+                if (contribution(q.surface, combined.emitter, combined.u).getLuminance() > 0.f)
+                    Z += std::min(q.reservoir.M, historyLimit);
+            }
+            if (target > 0.f && Z > 0)
+                combined.W = combined.wSum / (Z * target);
+
+            if (combined.W > 0.f && !scene->rayIntersect(lRec.shadowRay))
+                L_ems = value * combined.W;
+        }
+
+        if (state) {
+            state->surface = surface;
+            state->reservoir = combined;
+        }
+
+        if (aov)
+            aov->setSplit(Le + L_ems, Color3f(0.0f));
+        return Le + L_ems;
+    }
+
+    std::string toString() const {
+        return tfm::format(
+            "ReSTIRIntegrator[\n"
+            "  candidates = %i,\n"
+            "  spatialSamples = %i,\n"
+            "  spatialRadius = %f,\n"
+            "  temporalReuse = %s,\n"
+            "  historyLimit = %i\n"
+            "]",
+            m_candidates, m_spatialSamples, m_spatialRadius,
+            m_temporalReuse ? "true" : "false", m_historyLimit);
+    }
+
+protected:
+    /// Shading point of a pixel, as needed to evaluate the target function
+    struct Surface {
+        Point3f p;
+        float t;
+        Point2f uv;
+        Frame shFrame;
+        /// Direction towards the camera (in the local frame)
+        Vector3f wo;
+        const Shape *mesh = nullptr;
+    };
+
+    /// Weighted reservoir holding a single light sample
+    struct Reservoir {
+        const Emitter *emitter = nullptr;
+        /// Random numbers passed to Emitter::sample()
+        Point2f u;
+        /// Sum of the resampling weights
+        float wSum = 0.f;
+        /// Unbiased contribution weight of the selected sample
+        float W = 0.f;
+        /// Number of candidates that were seen
+        uint32_t M = 0;
+
+        void update(const Emitter *e, const Point2f &sampleU, float w, uint32_t count, float rnd) {
+            M += count;
+            if (!(w > 0.f))
+                return;
+            wSum += w;
+            if (rnd * wSum < w) {
+                emitter = e;
+                u = sampleU;
+            }
+        }
+    };
+
+    struct PixelState {
+        Surface surface;
+        Reservoir reservoir;
+    };
+
+    /// Unshadowed contribution of a light sample to a shading point
+    Color3f contribution(const Surface &s, const Emitter *emitter, const Point2f &u,
+            EmitterQueryRecord *lRecOut = nullptr) const {
+        EmitterQueryRecord lRec(s.p);
+        Color3f value = emitter->sample(lRec, u);
+        if (lRecOut)
+            *lRecOut = lRec;
+        if (!value.isValid())
+            return Color3f(0.0f);
+
+        BSDFQueryRecord bRec(s.wo, s.shFrame.toLocal(lRec.wi), ESolidAngle);
+        bRec.uv = s.uv;
+        bRec.p = s.p;
+        float cosTheta = Frame::cosTheta(bRec.wo);
+        if (cosTheta <= 0.f)
+            return Color3f(0.0f);
+        return value * s.mesh->getBSDF()->eval(bRec) * cosTheta;
+    }
+
+    /// Can the reservoir of \c q be reused at \c s? (rejects geometric discontinuities)
+    bool isSimilar(const Surface &s, const PixelState &q) const {
+        if (q.surface.mesh == nullptr || q.reservoir.M == 0)
+            return false;
+        return s.shFrame.n.dot(q.surface.shFrame.n) > 0.9f &&
+            std::abs(q.surface.t - s.t) <= 0.1f * s.t;
+    }
+
+private:
+    int m_candidates;
+    int m_spatialSamples;
+    float m_spatialRadius;
+    bool m_temporalReuse;
+    int m_historyLimit;
+
+    Vector2i m_size = Vector2i(0, 0);
+    mutable std::vector<PixelState> m_current;   ///< Reservoirs written during the current pass
+    std::vector<PixelState> m_previous;          ///< Reservoirs of the previous pass (read-only)
+    std::unique_ptr<std::atomic<uint32_t>[]> m_written; ///< Pass that last wrote each pixel
+    uint32_t m_generation = 0;                   ///< Number of passes so far (stamps start at 1)
+};
+
+NORI_REGISTER_CLASS(ReSTIRIntegrator, "restir");
+NORI_NAMESPACE_END
@@ -96,6 +96,28 @@ public:
         return D * Frame::cosTheta(wh) * Jh;
     }
 
+    /**
+     * \brief Evaluate the BRDF together with the sampling density
+     *
+     * Equivalent to calling \ref eval() and \ref pdf(), but the half
+     * vector and the distribution term are only computed once.
+     */
+    Color3f evalAndPdf(const BSDFQueryRecord &bRec, float &pdf) const {
+        Vector3f wh = (bRec.wi + bRec.wo).normalized();
+
+        float D = evalBeckmann(wh);
+        Color3f F = fresnelCond((wh.dot(bRec.wo)), m_eta, m_k);
+        float G = smithBeckmannG1(bRec.wi, wh) * smithBeckmannG1(bRec.wo,wh);
+
+        pdf = 0.f;
+        if (Frame::cosTheta(bRec.wo) > 0) {
+            float Jh = 1.f / (4.f * wh.dot(bRec.wo));
+            pdf = D * Frame::cosTheta(wh) * Jh;
+        }
+
+        return D * F * G / (4.f * Frame::cosTheta(bRec.wi) * Frame::cosTheta(bRec.wo));
+    }
+
     /// Sample the BRDF
     virtual Color3f sample(BSDFQueryRecord &bRec, const Point2f &_sample) const override {
     
@@ -106,11 +128,18 @@ public:
         Point2f sample = _sample;
         Vector3f wh = Warp::squareToBeckmann(sample, m_alpha);
         bRec.wo = ((2.f * wh.dot(bRec.wi) * wh) - bRec.wi).normalized();
+        bRec.measure = ESolidAngle;
+        bRec.sampledLobe = EGlossy;
         
         if (Frame::cosTheta(bRec.wo) <= 0) {
             return Color3f(0.0f);
         }
-        return eval(bRec) * Frame::cosTheta(bRec.wo) / pdf(bRec);
+        Color3f value = evalAndPdf(bRec, bRec.pdf);
+        return value * Frame::cosTheta(bRec.wo) / bRec.pdf;
+    }
+
+    virtual uint32_t getFlags() const override {
+        return EGlossy;
     }
 
     virtual std::string toString() const override {
@@ -22,17 +22,30 @@
 #include <nori/sampler.h>
 #include <nori/camera.h>
 #include <nori/emitter.h>
+#include <Eigen/Geometry>
 
 NORI_NAMESPACE_BEGIN
 
-Scene::Scene(const PropertyList &) {
+Scene::Scene(const PropertyList &props) : m_bvhBuilt(false) {
     m_bvh = new BVH();
+
+    /* Emitter selection strategy for next event estimation */
+    std::string lightSampler = props.getString("lightSampler", "uniform");
+    if (lightSampler == "tree")
+        m_useLightTree = true;
+    else if (lightSampler != "uniform")
+        throw NoriException("Scene: unknown light sampler \"%s\"!", lightSampler);
+
+    /* The renderer parses its settings from the same properties */
+    m_properties = props;
 }
 
 Scene::~Scene() {
     delete m_bvh;
     delete m_sampler;
     delete m_camera;
+    for (auto c : m_keyCameras)
+        delete c;
     delete m_integrator;
     delete m_medium;
     for(auto e : m_emitters)
@@ -40,9 +53,16 @@ Scene::~Scene() {
     m_emitters.clear();
 }
 
-void Scene::activate() {
+void Scene::buildBVH() const {
+    /* Concurrent first rays wait for a single build */
+    std::lock_guard<std::mutex> lock(m_bvhMutex);
+    if (m_bvhBuilt.load(std::memory_order_relaxed))
+        return;
     m_bvh->build();
+    m_bvhBuilt.store(true, std::memory_order_release);
+}
 
+void Scene::activate() {
     if (!m_integrator)
         throw NoriException("No integrator was specified!");
     if (!m_camera)
@@ -55,11 +75,78 @@ void Scene::activate() {
         m_sampler->activate();
     }
 
+    if (m_useLightTree)
+        m_lightTree.build(m_emitters);
+
     cout << endl;
     cout << "Configuration: " << toString() << endl;
     cout << endl;
 }
 
+/**
+ * Interpolate between two camera-to-world transformations: the position
+ * linearly, and the viewing and up directions along great circles. The
+ * result keeps the handedness of \c a.
+ */
+static Transform interpolateCamera(const Transform &a, const Transform &b, float t) {
+    const Eigen::Matrix4f &ma = a.getMatrix(), &mb = b.getMatrix();
+    auto slerp = [t](const Vector3f &u, const Vector3f &v) -> Vector3f {
+        float angle = std::acos(clamp(u.dot(v), -1.0f, 1.0f));
+        if (angle < 1e-4f)
+            return ((1 - t) * u + t * v).normalized();
+        return (std::sin((1 - t) * angle) * u + std::sin(t * angle) * v) / std::sin(angle);
+    };
+
+    Vector3f left  = ma.block<3, 1>(0, 0).normalized(),
+             up0   = ma.block<3, 1>(0, 1).normalized(),
+             dir0  = ma.block<3, 1>(0, 2).normalized();
+    Vector3f dir = slerp(dir0, mb.block<3, 1>(0, 2).normalized()).normalized();
+    Vector3f up = slerp(up0, mb.block<3, 1>(0, 1).normalized());
+    up = (up - up.dot(dir) * dir).normalized();
+    float handedness = left.dot(up0.cross(dir0)) < 0 ? -1.0f : 1.0f;
+
+    Eigen::Matrix4f result = Eigen::Matrix4f::Identity();
+    result.block<3, 1>(0, 0) = handedness * up.cross(dir);
+    result.block<3, 1>(0, 1) = up;
+    result.block<3, 1>(0, 2) = dir;
+    result.block<3, 1>(0, 3) = (1 - t) * ma.block<3, 1>(0, 3) + t * mb.block<3, 1>(0, 3);
+    return Transform(result);
+}
+
+void Scene::setFrame(uint32_t frame, uint32_t frames, bool turntable) {
+    size_t keys = m_cameraKeys.size();
+    if (frame >= frames)
+        throw NoriException("Scene::setFrame(): frame %i does not exist!", frame);
+
+    Transform cameraToWorld;
+    if (turntable) {
+        /* Orbit the first camera around the scene's center, about the
+           camera's up axis */
+        const Eigen::Matrix4f &m = m_cameraKeys[0].getMatrix();
+        Vector3f axis = m.block<3, 1>(0, 1).normalized();
+        Point3f center = getBoundingBox().getCenter();
+        float angle = 2 * M_PI * frame / frames;
+        Eigen::Affine3f orbit = Eigen::Translation3f(center) *
+            Eigen::AngleAxisf(angle, axis) * Eigen::Translation3f(-center);
+        cameraToWorld = Transform(orbit.matrix() * m);
+    } else if (keys == 1 || frames == 1) {
+        cameraToWorld = m_cameraKeys[0];
+    } else if (frames == keys) {
+        cameraToWorld = m_cameraKeys[frame];
+    } else {
+        /* Spread the frames evenly over the path through the keys */
+        float t = frame * (keys - 1) / (float) (frames - 1);
+        size_t i = std::min((size_t) t, keys - 2);
+        if (t == i)
+            cameraToWorld = m_cameraKeys[i];
+        else if (t == i + 1)
+            cameraToWorld = m_cameraKeys[i + 1];
+        else
+            cameraToWorld = interpolateCamera(m_cameraKeys[i], m_cameraKeys[i + 1], t - i);
+    }
+    m_camera->setCameraToWorld(cameraToWorld);
+}
+
 void Scene::addChild(NoriObject *obj) {
     switch (obj->getClassType()) {
         case EMesh: {
@@ -81,10 +168,16 @@ void Scene::addChild(NoriObject *obj) {
             m_sampler = static_cast<Sampler *>(obj);
             break;
 
-        case ECamera:
-            if (m_camera)
-                throw NoriException("There can only be one camera per scene!");
-            m_camera = static_cast<Camera *>(obj);
+        case ECamera: {
+                /* Further cameras only contribute their position as
+                   keys of a camera animation (see setFrame()) */
+                Camera *camera = static_cast<Camera *>(obj);
+                m_cameraKeys.push_back(camera->getCameraToWorld());
+                if (m_camera)
+                    m_keyCameras.push_back(camera);
+                else
+                    m_camera = camera;
+            }
             break;
         
         case EIntegrator:
@@ -127,6 +220,7 @@ std::string Scene::toString() const {
         "  integrator = %s,\n"
         "  sampler = %s\n"
         "  camera = %s,\n"
+        "  lightSampler = %s,\n"
         "  shapes = {\n"
         "  %s  }\n"
         "  emitters = {\n"
@@ -135,6 +229,7 @@ std::string Scene::toString() const {
         indent(m_integrator->toString()),
         indent(m_sampler->toString()),
         indent(m_camera->toString()),
+        m_useLightTree ? m_lightTree.toString() : std::string("uniform"),
         indent(shapes, 2),
         indent(lights,2)
     );
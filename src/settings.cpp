@@ -0,0 +1,160 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <nori/settings.h>
+#include <nori/render.h>
+
+NORI_NAMESPACE_BEGIN
+
+RenderSettings::RenderSettings(const PropertyList &props) {
+    /* Number of samples per pixel that a tile renders before it is merged
+       into the image (0: adaptive) */
+    samplesPerPass = props.getInteger("samplesPerPass", 1);
+    if (samplesPerPass < 0)
+        throw NoriException("Scene: 'samplesPerPass' must be nonnegative!");
+
+    /* Adaptive sampling: target error and per-pixel sample cap
+       (0: four times the sampler's sample count) */
+    adaptiveThreshold = props.getFloat("adaptiveThreshold", 0.0f);
+    if (adaptiveThreshold < 0)
+        throw NoriException("Scene: 'adaptiveThreshold' must be nonnegative!");
+    int maxSamples = props.getInteger("maxSampleCount", 0);
+    if (maxSamples < 0)
+        throw NoriException("Scene: 'maxSampleCount' must be nonnegative!");
+    maxSampleCount = (uint32_t) maxSamples;
+
+    /* Wall-clock time budget in seconds (0: render the sampler's sample count) */
+    timeBudget = props.getFloat("timeBudget", 0.0f);
+    if (timeBudget < 0)
+        throw NoriException("Scene: 'timeBudget' must be nonnegative!");
+
+    /* Tiling of the image (block size 0: automatic) */
+    blockSize = props.getInteger("blockSize", 0);
+    if (blockSize < 0)
+        throw NoriException("Scene: 'blockSize' must be nonnegative!");
+    blockOrder = BlockGenerator::orderFromString(props.getString("blockOrder", "spiral"));
+
+    /* Crop window in pixels (size 0: the whole image) */
+    cropOffset = Point2i(props.getInteger("cropX", 0), props.getInteger("cropY", 0));
+    cropSize = Vector2i(props.getInteger("cropWidth", 0), props.getInteger("cropHeight", 0));
+    if ((cropOffset.array() < 0).any() || (cropSize.array() < 0).any())
+        throw NoriException("Scene: the crop window must be nonnegative!");
+    if ((cropSize.array() == 0).any() && (cropSize.array() != 0).any())
+        throw NoriException("Scene: 'cropWidth' and 'cropHeight' must be given together!");
+    cropOutput = props.getBoolean("cropOutput", false);
+
+    /* Auxiliary images rendered in the same pass (e.g. "albedo,normal") */
+    aovs = AOVRecord::parseList(props.getString("aovs", ""));
+    denoise = props.getBoolean("denoise", false);
+    denoiseIterations = props.getInteger("denoiseIterations", 5);
+    if (denoiseIterations < 1)
+        throw NoriException("Scene: 'denoiseIterations' must be positive!");
+
+    /* Threads of the rendering (0: one per core), optionally confined to a NUMA node */
+    threads = props.getInteger("threads", 0);
+    if (threads < 0)
+        throw NoriException("Scene: 'threads' must be nonnegative!");
+    numaNode = props.getInteger("numaNode", -1);
+    pinThreads = props.getBoolean("pinThreads", false);
+
+    /* Frames of a batch rendering (0: one per camera) */
+    int frameCount = props.getInteger("frames", 0);
+    if (frameCount < 0)
+        throw NoriException("Scene: 'frames' must be nonnegative!");
+    frames = (uint32_t) frameCount;
+    turntable = props.getBoolean("turntable", false);
+
+    /* Validation of the sample values in the image blocks */
+    checkSamples = props.getBoolean("checkSamples", true);
+}
+
+void RenderSettings::applyOverrides(const RenderOptions &options) {
+    if (options.timeBudget > 0)
+        timeBudget = options.timeBudget;
+    if ((options.cropSize.array() > 0).all()) {
+        cropOffset = options.cropOffset;
+        cropSize = options.cropSize;
+    }
+    if (options.cropOutput)
+        cropOutput = true;
+    if (!options.aovs.empty())
+        aovs = AOVRecord::parseList(options.aovs);
+    if (options.denoise)
+        denoise = true;
+    if (options.threads > 0)
+        threads = options.threads;
+    if (options.numaNode >= 0)
+        numaNode = options.numaNode;
+    if (options.pinThreads)
+        pinThreads = true;
+    if (options.frames > 0)
+        frames = (uint32_t) options.frames;
+    if (options.turntable)
+        turntable = true;
+}
+
+/// Comma-separated names of a list of AOVs
+static std::string aovList(const std::vector<AOVRecord::EType> &aovs) {
+    if (aovs.empty())
+        return "none";
+    std::string result;
+    for (size_t i = 0; i < aovs.size(); ++i)
+        result += (i > 0 ? "," : "") + AOVRecord::typeName(aovs[i]);
+    return result;
+}
+
+std::string RenderSettings::toString() const {
+    return tfm::format(
+        "RenderSettings[\n"
+        "  samplesPerPass = %s,\n"
+        "  adaptiveThreshold = %s,\n"
+        "  maxSampleCount = %s,\n"
+        "  timeBudget = %s,\n"
+        "  blockSize = %s,\n"
+        "  blockOrder = %s,\n"
+        "  crop = %s,\n"
+        "  aovs = %s,\n"
+        "  denoise = %s,\n"
+        "  frames = %s%s,\n"
+        "  threads = %s,\n"
+        "  numaNode = %s,\n"
+        "  pinThreads = %s,\n"
+        "  checkSamples = %s\n"
+        "]",
+        samplesPerPass == 0 ? std::string("adaptive") : std::to_string(samplesPerPass),
+        adaptiveThreshold == 0 ? std::string("disabled") : std::to_string(adaptiveThreshold),
+        maxSampleCount == 0 ? std::string("automatic") : std::to_string(maxSampleCount),
+        timeBudget == 0 ? std::string("none") : tfm::format("%.1fs", timeBudget),
+        blockSize == 0 ? std::string("automatic") : std::to_string(blockSize),
+        blockOrder == BlockGenerator::EHilbert ? "hilbert" :
+            (blockOrder == BlockGenerator::EMorton ? "morton" : "spiral"),
+        cropSize.x() == 0 ? std::string("none") :
+            tfm::format("%i,%i,%i,%i%s", cropOffset.x(), cropOffset.y(), cropSize.x(),
+                        cropSize.y(), cropOutput ? " (cropped output)" : ""),
+        aovList(aovs),
+        denoise ? tfm::format("%i iterations", denoiseIterations) : std::string("false"),
+        frames == 0 ? std::string("automatic") : std::to_string(frames),
+        turntable ? " (turntable)" : "",
+        threads == 0 ? std::string("automatic") : std::to_string(threads),
+        numaNode < 0 ? std::string("any") : std::to_string(numaNode),
+        pinThreads ? "true" : "false",
+        checkSamples ? "true" : "false"
+    );
+}
+
+NORI_NAMESPACE_END
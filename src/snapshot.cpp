@@ -0,0 +1,105 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <nori/snapshot.h>
+#include <nori/bitmap.h>
+#include <cstdio>
+
+NORI_NAMESPACE_BEGIN
+
+SnapshotWriter::SnapshotWriter() : m_written(0) {
+    m_thread = std::thread([this] { run(); });
+}
+
+SnapshotWriter::~SnapshotWriter() {
+    stop();
+}
+
+void SnapshotWriter::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_one();
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+void SnapshotWriter::submit(const ImageBlock &block, const Point2i &offset, const Vector2i &size,
+                            bool crop, const std::string &filename) {
+    Point2i origin = offset - block.getOffset();
+    if ((origin.array() < 0).any() || ((origin + size).array() > block.getSize().array()).any())
+        throw NoriException("SnapshotWriter::submit(): the region exceeds the block!");
+
+    {
+        /* Only a copy: the background thread does all other work. The
+           allocation of the back buffer is reused between snapshots */
+        std::lock_guard<std::mutex> lock(m_mutex);
+        int border = block.getBorderSize();
+        m_back.pixels = block.block(origin.y() + border, origin.x() + border, size.y(), size.x());
+        m_back.origin = crop ? Point2i(0, 0) : origin;
+        m_back.imageSize = crop ? size : block.getSize();
+        m_back.filename = filename;
+        m_pending = true;
+    }
+    m_cond.notify_one();
+}
+
+void SnapshotWriter::run() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this] { return m_pending || m_stop; });
+
+            /* Write the last submitted snapshot before exiting */
+            if (m_stop && !m_pending)
+                return;
+
+            /* Take the latest snapshot (swapping the buffers does not copy any pixels) */
+            m_front.pixels.swap(m_back.pixels);
+            std::swap(m_front.origin, m_back.origin);
+            std::swap(m_front.imageSize, m_back.imageSize);
+            std::swap(m_front.filename, m_back.filename);
+            m_pending = false;
+        }
+
+        /* Normalize the pixels (and leave the rest of a full-size image black) */
+        const Buffer &buffer = m_front;
+        Bitmap bitmap(buffer.imageSize);
+        bitmap.setConstant(Color3f(0.0f));
+        for (int y = 0; y < buffer.pixels.rows(); ++y)
+            for (int x = 0; x < buffer.pixels.cols(); ++x)
+                bitmap.coeffRef(buffer.origin.y() + y, buffer.origin.x() + x) =
+                    buffer.pixels.coeff(y, x).divideByFilterWeight();
+
+        std::string tempName = buffer.filename + ".tmp";
+        try {
+            if (endsWith(toLower(buffer.filename), ".png"))
+                bitmap.saveToLDR(tempName, false);
+            else
+                bitmap.save(tempName, std::vector<Bitmap::Layer>(), false);
+            if (std::rename(tempName.c_str(), buffer.filename.c_str()) != 0)
+                throw NoriException("Unable to replace the snapshot \"%s\"!", buffer.filename);
+            ++m_written;
+        } catch (const std::exception &e) {
+            cerr << "Warning: " << e.what() << endl;
+        }
+    }
+}
+
+NORI_NAMESPACE_END
@@ -0,0 +1,106 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <nori/sampler.h>
+#include <nori/block.h>
+#include <nori/qmc.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * Owen-scrambled Sobol sampling
+ *
+ * Every 1D or 2D request is served by the first one or two dimensions of
+ * the Sobol sequence, which form a (0,2)-sequence in base 2. To avoid
+ * correlation between requests, the sample index is shuffled and the
+ * values are Owen-scrambled with seeds that depend on the pixel and the
+ * dimension ("padding"), following "Practical Hash-based Owen Scrambling"
+ * by Brent Burley (JCGT 2020). The first 2^k samples of a pixel are thus
+ * stratified in every 2D projection that an integrator uses.
+ *
+ * Works best with power-of-two sample counts.
+ */
+class Sobol final : public SamplerImpl<Sobol> {
+public:
+    Sobol(const PropertyList &propList) {
+        m_sampleCount = (size_t) propList.getInteger("sampleCount", 1);
+        m_seed = (uint32_t) propList.getInteger("seed", 0);
+    }
+
+    virtual ~Sobol() { }
+
+    std::unique_ptr<Sampler> clone() const {
+        std::unique_ptr<Sobol> cloned(new Sobol());
+        cloned->m_sampleCount = m_sampleCount;
+        cloned->m_seedOffset = m_seedOffset;
+        cloned->m_seed = m_seed;
+        cloned->m_pixel = m_pixel;
+        cloned->m_sampleIndex = m_sampleIndex;
+        cloned->m_dimension = m_dimension;
+        return cloned;
+    }
+
+    void prepare(const ImageBlock &block) {
+        startPixelSample(block.getOffset(), 0, 0);
+    }
+
+    void startPixelSample(const Point2i &pixel, uint32_t sampleIndex, uint32_t dimension) {
+        m_pixel = pixel;
+        m_sampleIndex = sampleIndex;
+        m_dimension = dimension;
+    }
+
+    void generate() { m_dimension = 0; }
+    void advance()  { ++m_sampleIndex; m_dimension = 0; }
+
+    float next1D() {
+        uint64_t hash = QMC::hash(m_pixel, m_dimension++, m_seed + m_seedOffset);
+        uint32_t index = QMC::owenScramble(m_sampleIndex, (uint32_t) hash);
+        return QMC::toFloat(QMC::owenScramble(QMC::sobol(index, 0), (uint32_t) (hash >> 32)));
+    }
+
+    Point2f next2D() {
+        uint64_t hash = QMC::hash(m_pixel, m_dimension, m_seed + m_seedOffset);
+        uint64_t hash2 = QMC::mixBits(hash);
+        m_dimension += 2;
+        uint32_t index = QMC::owenScramble(m_sampleIndex, (uint32_t) hash);
+        return Point2f(
+            QMC::toFloat(QMC::owenScramble(QMC::sobol(index, 0), (uint32_t) (hash >> 32))),
+            QMC::toFloat(QMC::owenScramble(QMC::sobol(index, 1), (uint32_t) hash2))
+        );
+    }
+
+    /* All state is set by startPixelSample() */
+    void serialize(std::ostream &stream) const { }
+    void unserialize(std::istream &stream) { }
+
+    virtual std::string toString() const override {
+        return tfm::format("Sobol[sampleCount=%i, seed=%i]", m_sampleCount, m_seed);
+    }
+protected:
+    Sobol() { }
+
+private:
+    uint32_t m_seed = 0;
+    Point2i m_pixel = Point2i(0, 0);
+    uint32_t m_sampleIndex = 0;
+    uint32_t m_dimension = 0;
+};
+
+NORI_REGISTER_CLASS(Sobol, "sobol");
+NORI_NAMESPACE_END
@@ -37,6 +37,8 @@ public:
 
     virtual Point3f getCentroid(uint32_t index) const override { return m_position; }
 
+    virtual float getSurfaceArea() const override { return 4 * M_PI * m_radius * m_radius; }
+
     virtual bool rayIntersect(uint32_t index, const Ray3f &ray, float &u, float &v, float &t) const override {
         
         Point3f C = m_position;
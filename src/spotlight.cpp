@@ -1,4 +1,5 @@
 #include <nori/emitter.h>
+#include <nori/lighttree.h>
 #include <nori/warp.h>
 #include <nori/scene.h>
 #include <nori/integrator.h>
@@ -73,6 +74,16 @@ public:
         return Warp::squareToUniformSphereCapPdf(Vector3f(0,0,1),m_cosCone) * (lRec.p - lRec.ref).squaredNorm() / cosTheta;
     }
         
+    /// Emission from a single point, restricted to the cone
+    virtual bool getLightBounds(LightBounds &bounds) const override {
+        bounds.bbox = BoundingBox3f(m_lightPos);
+        bounds.w = m_lightDir;
+        bounds.phi = m_power.getLuminance();
+        bounds.cosTheta_o = 1.0f;
+        bounds.cosTheta_e = m_cosCone;
+        return true;
+    }
+
     virtual std::string toString() const {
         return "SpotLight[]";
     }
@@ -0,0 +1,130 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <nori/sampler.h>
+#include <nori/block.h>
+#include <nori/qmc.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * Stratified (jittered) sampling
+ *
+ * The domain of every dimension is split into one stratum per pixel
+ * sample, and each sample of a pixel falls into a different stratum
+ * (the assignment is a random permutation that depends on the pixel and
+ * the dimension). 2D requests use a jittered grid when the sample count
+ * is a perfect square and a Latin hypercube otherwise. Samples beyond the
+ * configured count start a new, independently permuted set of strata.
+ *
+ * Setting \c jitter to \c false places every sample at the center of its
+ * stratum, which is biased but occasionally useful for debugging.
+ */
+class Stratified final : public SamplerImpl<Stratified> {
+public:
+    Stratified(const PropertyList &propList) {
+        m_sampleCount = (size_t) propList.getInteger("sampleCount", 1);
+        m_seed = (uint32_t) propList.getInteger("seed", 0);
+        m_jitter = propList.getBoolean("jitter", true);
+        if (m_sampleCount == 0)
+            throw NoriException("Stratified: the sample count must be positive!");
+    }
+
+    virtual ~Stratified() { }
+
+    std::unique_ptr<Sampler> clone() const {
+        std::unique_ptr<Stratified> cloned(new Stratified());
+        cloned->m_sampleCount = m_sampleCount;
+        cloned->m_seedOffset = m_seedOffset;
+        cloned->m_seed = m_seed;
+        cloned->m_jitter = m_jitter;
+        cloned->m_pixel = m_pixel;
+        cloned->m_sampleIndex = m_sampleIndex;
+        cloned->m_dimension = m_dimension;
+        return cloned;
+    }
+
+    void prepare(const ImageBlock &block) {
+        startPixelSample(block.getOffset(), 0, 0);
+    }
+
+    void startPixelSample(const Point2i &pixel, uint32_t sampleIndex, uint32_t dimension) {
+        m_pixel = pixel;
+        m_sampleIndex = sampleIndex;
+        m_dimension = dimension;
+    }
+
+    void generate() { m_dimension = 0; }
+    void advance()  { ++m_sampleIndex; m_dimension = 0; }
+
+    float next1D() {
+        uint32_t n = (uint32_t) m_sampleCount, i = m_sampleIndex % n;
+        uint64_t hash = strataHash(m_dimension++);
+        uint32_t stratum = QMC::permutationElement(i, n, (uint32_t) hash);
+        return std::min((stratum + jitter(hash, 2 * i)) / n, NORI_ONE_MINUS_EPSILON);
+    }
+
+    Point2f next2D() {
+        uint32_t n = (uint32_t) m_sampleCount, i = m_sampleIndex % n;
+        uint64_t hash = strataHash(m_dimension);
+        m_dimension += 2;
+
+        uint32_t gridSize = (uint32_t) std::round(std::sqrt((float) n));
+        Point2f p;
+        if (gridSize * gridSize == n) {
+            uint32_t cell = QMC::permutationElement(i, n, (uint32_t) hash);
+            p = Point2f((cell % gridSize + jitter(hash, 2 * i)) / gridSize,
+                        (cell / gridSize + jitter(hash, 2 * i + 1)) / gridSize);
+        } else {
+            p = Point2f((QMC::permutationElement(i, n, (uint32_t) hash) + jitter(hash, 2 * i)) / n,
+                        (QMC::permutationElement(i, n, (uint32_t) (hash >> 32)) + jitter(hash, 2 * i + 1)) / n);
+        }
+        return p.cwiseMin(Point2f(NORI_ONE_MINUS_EPSILON));
+    }
+
+    /* All state is set by startPixelSample() */
+    void serialize(std::ostream &stream) const { }
+    void unserialize(std::istream &stream) { }
+
+    virtual std::string toString() const override {
+        return tfm::format("Stratified[sampleCount=%i, seed=%i, jitter=%s]",
+                           m_sampleCount, m_seed, m_jitter ? "true" : "false");
+    }
+protected:
+    Stratified() { }
+
+    /// Seed of the strata of a dimension (new strata for every m_sampleCount samples)
+    uint64_t strataHash(uint32_t dimension) const {
+        return QMC::hash(QMC::hash(m_pixel, dimension, m_seed + m_seedOffset), m_sampleIndex / m_sampleCount);
+    }
+
+    /// Position of a sample within its stratum
+    float jitter(uint64_t hash, uint32_t index) const {
+        return m_jitter ? QMC::toFloat(QMC::hash(hash, index)) : 0.5f;
+    }
+
+private:
+    uint32_t m_seed = 0;
+    bool m_jitter = true;
+    Point2i m_pixel = Point2i(0, 0);
+    uint32_t m_sampleIndex = 0;
+    uint32_t m_dimension = 0;
+};
+
+NORI_REGISTER_CLASS(Stratified, "stratified");
+NORI_NAMESPACE_END
@@ -44,20 +44,23 @@ public:
                 Vector3f dir = Warp::squareToUniformSphere(sampler->next2D());
                 nRay = Ray3f(nRay.o + t * nRay.d.normalized(), dir);
                 
-                // Emitter sampling
-                const Emitter* emitter = scene->getRandomEmitter(sampler->next1D());
-                EmitterQueryRecord lRec(nRay.o);
-                Color3f Le = emitter->sample(lRec, sampler->next2D())*scene->getLights().size();
+                // Emitter sampling (a point in the medium has no normal)
+                float pdf_light;
+                const Emitter* emitter = scene->sampleEmitter(nRay.o, Normal3f(0.0f), sampler->next1D(), pdf_light);
+                th *= albedo;
+                if (emitter) {
+                    EmitterQueryRecord lRec(nRay.o);
+                    Color3f Le = emitter->sample(lRec, sampler->next2D()) / pdf_light;
                 
-                // Check the shadowray
-                Intersection its_sh;
-                if (scene->rayIntersect(lRec.shadowRay, its_sh)) {
-                    Le = 0.0f;
-                }
+                    // Check the shadowray
+                    Intersection its_sh;
+                    if (scene->rayIntersect(lRec.shadowRay, its_sh)) {
+                        Le = 0.0f;
+                    }
                 
-                // Update throughput and add light contribution
-                th *= albedo;
-                Li += th * medium->transmittance(nRay.o, lRec.p) * phaseF * Le;
+                    // Add light contribution with the updated throughput
+                    Li += th * medium->transmittance(nRay.o, lRec.p) * phaseF * Le;
+                }
                 
             // Surface interaction
             } else {
@@ -68,35 +71,37 @@ public:
                     Color3f Le = its.mesh->getEmitter()->eval(lRec);
                     Li += th * medium->transmittance(nRay.o, its.p) * Le;
 
-                // Normal surface
-                } else {
+                // Normal surface (purely specular ones cannot be lit by emitter sampling)
+                } else if (its.mesh->getBSDF()->hasSmoothComponent()) {
                     
                     // Emitter sampling
-                    const Emitter* emitter = scene->getRandomEmitter(sampler->next1D());
-                    EmitterQueryRecord lRec(its.p);
-                    Color3f Le = emitter->sample(lRec, sampler->next2D())*scene->getLights().size();
-                    //float pdf_e = emitter->pdf(lRec);
+                    float pdf_light;
+                    const Emitter* emitter = scene->sampleEmitter(its.p, its.shFrame.n, sampler->next1D(), pdf_light);
+                    if (emitter) {
+                        EmitterQueryRecord lRec(its.p);
+                        Color3f Le = emitter->sample(lRec, sampler->next2D()) / pdf_light;
+                        //float pdf_e = emitter->pdf(lRec);
                 
-                    BSDFQueryRecord bRec(its.shFrame.toLocal(-nRay.d), its.shFrame.toLocal(lRec.wi), ESolidAngle);
-                    bRec.uv = its.uv;
-                    Color3f BSDF = its.mesh->getBSDF()->eval(bRec);
-                    //float pdf_b = its.mesh->getBSDF()->pdf(bRec);
+                        BSDFQueryRecord bRec(its.shFrame.toLocal(-nRay.d), its.shFrame.toLocal(lRec.wi), ESolidAngle);
+                        bRec.uv = its.uv;
+                        Color3f BSDF = its.mesh->getBSDF()->eval(bRec);
+                        //float pdf_b = its.mesh->getBSDF()->pdf(bRec);
                 
-                    // Check the shadowray
-                    Intersection its_sh;
-                    if (scene->rayIntersect(lRec.shadowRay, its_sh)) {
-                        Le = 0.0f;
-                    }
+                        // Check the shadowray
+                        if (scene->rayIntersect(lRec.shadowRay)) {
+                            Le = 0.0f;
+                        }
                 
-                    //float pdf = exp(-sigmaT.minCoeff()*tmax);
-                    //float pdf = its.mesh->getBSDF()->pdf(bRec);
-                    //if (pdf <= 0.f) pdf = 1.f;
-                    //pdf = pdf == 0.f ? 1.f : pdf;
-                    //float w = 1.f;
-                    //if (pdf_e + pdf_b > 0.0f) w = pdf_e / (pdf_b + pdf_e);
+                        //float pdf = exp(-sigmaT.minCoeff()*tmax);
+                        //float pdf = its.mesh->getBSDF()->pdf(bRec);
+                        //if (pdf <= 0.f) pdf = 1.f;
+                        //pdf = pdf == 0.f ? 1.f : pdf;
+                        //float w = 1.f;
+                        //if (pdf_e + pdf_b > 0.0f) w = pdf_e / (pdf_b + pdf_e);
                     
-                    // Light contribution with evaluated BSDF
-                    Li += th * BSDF * medium->transmittance(its.p, lRec.p) * Le;
+                        // Light contribution with evaluated BSDF
+                        Li += th * BSDF * medium->transmittance(its.p, lRec.p) * Le;
+                    }
                 }
                 
                 // Update ray with direction sampled by BSDF
@@ -0,0 +1,200 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+
+    Copyright (c) 2015 by Wenzel Jakob
+
+    Nori is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 3
+    as published by the Free Software Foundation.
+
+    Nori is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <nori/sampler.h>
+#include <nori/block.h>
+#include <nori/qmc.h>
+
+NORI_NAMESPACE_BEGIN
+
+/// Number of Morton levels (base-4 digits) of the pixel position whose order is randomized
+#define NORI_ZSOBOL_SCRAMBLED_PIXEL_DIGITS 6
+
+/// All 24 permutations of four elements
+static const uint8_t zsobolPermutations[24][4] = {
+    {0, 1, 2, 3}, {0, 1, 3, 2}, {0, 2, 1, 3}, {0, 2, 3, 1}, {0, 3, 2, 1}, {0, 3, 1, 2},
+    {1, 0, 2, 3}, {1, 0, 3, 2}, {1, 2, 0, 3}, {1, 2, 3, 0}, {1, 3, 2, 0}, {1, 3, 0, 2},
+    {2, 1, 0, 3}, {2, 1, 3, 0}, {2, 0, 1, 3}, {2, 0, 3, 1}, {2, 3, 0, 1}, {2, 3, 1, 0},
+    {3, 1, 2, 0}, {3, 1, 0, 2}, {3, 2, 1, 0}, {3, 2, 0, 1}, {3, 0, 2, 1}, {3, 0, 1, 2}
+};
+
+/**
+ * Blue-noise Sobol sampling
+ *
+ * Implements "Screen-Space Blue-Noise Diffusion of Monte Carlo Sampling
+ * Error via Hierarchical Ordering of Pixels" by Abdalla Ahmed and Peter
+ * Wonka (SIGGRAPH Asia 2020). All pixels draw their samples from a single
+ * Owen-scrambled Sobol sequence: the samples of a pixel are consecutive
+ * in the sequence, and pixels are ordered along a Morton curve whose
+ * base-4 digits are randomly permuted at every level. Neighbouring pixels
+ * therefore receive complementary strata of the same point set, which
+ * pushes the error of low sample counts into high screen-space
+ * frequencies (blue noise) where it is much less visible.
+ *
+ * Like the \c sobol sampler, every 1D or 2D request uses the first two
+ * Sobol dimensions with a different scramble, so no generator matrix
+ * tables are needed. Sample counts are rounded up to a power of two;
+ * samples beyond that count start a new, independently scrambled
+ * sequence, so that adaptive and time-budget rendering stay unbiased.
+ *
+ * The Morton code of the pixel and the sample index share the 32 bits
+ * of a Sobol point: 2*ceil(log2(resolution)) + log2(sample count) must
+ * not exceed 32 (e.g. up to 1024 samples at 2048x2048 pixels), which is
+ * checked when a block is prepared.
+ */
+class ZSobol final : public SamplerImpl<ZSobol> {
+public:
+    ZSobol(const PropertyList &propList) {
+        m_seed = (uint32_t) propList.getInteger("seed", 0);
+        setSampleCount((size_t) propList.getInteger("sampleCount", 1));
+    }
+
+    virtual ~ZSobol() { }
+
+    std::unique_ptr<Sampler> clone() const {
+        std::unique_ptr<ZSobol> cloned(new ZSobol());
+        cloned->m_sampleCount = m_sampleCount;
+        cloned->m_seedOffset = m_seedOffset;
+        cloned->m_log2SampleCount = m_log2SampleCount;
+        cloned->m_seed = m_seed;
+        cloned->m_mortonIndex = m_mortonIndex;
+        cloned->m_epoch = m_epoch;
+        cloned->m_dimension = m_dimension;
+        return cloned;
+    }
+
+    void setSampleCount(size_t sampleCount) {
+        if (sampleCount == 0)
+            throw NoriException("ZSobol: the sample count must be positive!");
+        m_sampleCount = sampleCount;
+        m_log2SampleCount = 0;
+        while (((size_t) 1 << m_log2SampleCount) < sampleCount)
+            ++m_log2SampleCount;
+    }
+
+    void prepare(const ImageBlock &block) {
+        /* The points of the sequence are 32-bit fractions, so the Morton
+           code of the pixel and the sample index must fit into 32 bits
+           (otherwise distant pixels receive the same points) */
+        int extent = (block.getOffset() + block.getSize()).maxCoeff(), pixelBits = 0;
+        while (pixelBits < 31 && (1 << pixelBits) < extent)
+            ++pixelBits;
+        if (2 * pixelBits + (int) m_log2SampleCount > 32)
+            throw NoriException("ZSobol: %i samples per pixel at pixel coordinates up to %i "
+                                "exceed the 32 bits of the sequence (2*ceil(log2(resolution)) + "
+                                "log2(sample count) must be at most 32)!",
+                                (size_t) 1 << m_log2SampleCount, extent);
+        startPixelSample(block.getOffset(), 0, 0);
+    }
+
+    void startPixelSample(const Point2i &pixel, uint32_t sampleIndex, uint32_t dimension) {
+        uint32_t mask = (1u << m_log2SampleCount) - 1;
+        m_mortonIndex = (QMC::encodeMorton2((uint32_t) pixel.x(), (uint32_t) pixel.y())
+            << m_log2SampleCount) | (sampleIndex & mask);
+        m_epoch = sampleIndex >> m_log2SampleCount;
+        m_dimension = dimension;
+    }
+
+    void generate() { m_dimension = 0; }
+
+    void advance() {
+        uint64_t mask = ((uint64_t) 1 << m_log2SampleCount) - 1;
+        m_mortonIndex = (m_mortonIndex & ~mask) | ((m_mortonIndex + 1) & mask);
+        if ((m_mortonIndex & mask) == 0)
+            ++m_epoch;
+        m_dimension = 0;
+    }
+
+    float next1D() {
+        uint64_t hash = dimensionHash(m_dimension);
+        uint64_t index = sampleIndex(hash);
+        m_dimension++;
+        return QMC::toFloat(QMC::owenScramble(QMC::sobol(index, 0), (uint32_t) (hash >> 32)));
+    }
+
+    Point2f next2D() {
+        uint64_t hash = dimensionHash(m_dimension);
+        uint64_t hash2 = QMC::mixBits(hash);
+        uint64_t index = sampleIndex(hash);
+        m_dimension += 2;
+        return Point2f(
+            QMC::toFloat(QMC::owenScramble(QMC::sobol(index, 0), (uint32_t) (hash >> 32))),
+            QMC::toFloat(QMC::owenScramble(QMC::sobol(index, 1), (uint32_t) hash2))
+        );
+    }
+
+    /* All state is set by startPixelSample() */
+    void serialize(std::ostream &stream) const { }
+    void unserialize(std::istream &stream) { }
+
+    virtual std::string toString() const override {
+        return tfm::format("ZSobol[sampleCount=%i, seed=%i]", m_sampleCount, m_seed);
+    }
+protected:
+    ZSobol() { }
+
+    /// Seed of a dimension (a new one for every m_sampleCount samples)
+    uint64_t dimensionHash(uint32_t dimension) const {
+        return QMC::hash(QMC::hash(m_seed + m_seedOffset, dimension), m_epoch);
+    }
+
+    /**
+     * \brief Index of the current sample in the global Sobol sequence
+     *
+     * Randomly permutes the base-4 digits of the Morton index, with a
+     * permutation that depends on the dimension and on all higher digits
+     * (i.e. on the enclosing quadtree node). An odd power of two sample
+     * count leaves a single base-2 digit at the bottom, which is flipped
+     * at random instead. Only the digits of the sample index and of the
+     * finest pixel levels are permuted: coarser levels do not affect the
+     * blue-noise property, and every value is uniformly distributed
+     * thanks to the Owen scrambling anyway.
+     */
+    uint64_t sampleIndex(uint64_t hash) const {
+        bool oddLog2 = (m_log2SampleCount & 1) != 0;
+        int digitCount = NORI_ZSOBOL_SCRAMBLED_PIXEL_DIGITS + (m_log2SampleCount + 1) / 2;
+        int lastDigit = oddLog2 ? 1 : 0;
+        int scrambledBits = 2 * NORI_ZSOBOL_SCRAMBLED_PIXEL_DIGITS + m_log2SampleCount;
+        uint64_t index = (m_mortonIndex >> scrambledBits) << scrambledBits;
+
+        for (int i = digitCount - 1; i >= lastDigit; --i) {
+            int shift = 2 * i - (oddLog2 ? 1 : 0);
+            uint32_t digit = (uint32_t) (m_mortonIndex >> shift) & 3;
+            uint64_t higherDigits = m_mortonIndex >> (shift + 2);
+            uint32_t p = (uint32_t) ((QMC::hash(hash, higherDigits) >> 24) % 24);
+            index |= (uint64_t) zsobolPermutations[p][digit] << shift;
+        }
+
+        if (oddLog2) {
+            uint64_t higherDigits = m_mortonIndex >> 1;
+            index |= (m_mortonIndex & 1) ^ (QMC::hash(hash, higherDigits) & 1);
+        }
+
+        return index;
+    }
+
+private:
+    uint32_t m_seed = 0;
+    int m_log2SampleCount = 0;
+    uint64_t m_mortonIndex = 0;
+    uint32_t m_epoch = 0;
+    uint32_t m_dimension = 0;
+};
+
+NORI_REGISTER_CLASS(ZSobol, "zsobol");
+NORI_NAMESPACE_END